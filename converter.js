@@ -0,0 +1,205 @@
+const { spawn } = require('child_process');
+const fs = require('fs');
+
+// Path to the compiled C++ converter.
+const CONVERTER_PATH = process.env.CONVERTER_PATH ?? '/app/sdk/convert';
+
+// How long past its timeout a request may go unanswered before the worker
+// itself is considered hung. The converter kills a forked job that runs out
+// of time and replies, so this only fires if the daemon stops responding.
+const HUNG_WORKER_GRACE_MS = 5000;
+
+// Rough cost of a Word conversion, matching EstimateCost in sdk/estimate.cpp
+// for a document whose page count is only known from its size. These only
+// need to rank requests, not predict them.
+const BASE_COST_MS = 1000;
+const PAGE_COST_MS = 150;
+const BYTES_PER_PAGE = 25000;
+
+// Encode a string as a frame: its byte length as a 4-byte big-endian
+// integer, followed by the UTF-8 bytes themselves.
+function frame(payload) {
+  const body = Buffer.from(payload, 'utf8');
+  const header = Buffer.alloc(4);
+  header.writeUInt32BE(body.length, 0);
+  return Buffer.concat([header, body]);
+}
+
+// A single long-lived `convert --daemon --framed` process. Requests are
+// written to its stdin and replies read from its stdout, both as frames
+// tagged with a request id. The daemon converts one request at a time, so
+// the pool only hands a worker its next request once the last one is done.
+class ConverterWorker {
+  constructor(args, onExit) {
+    this.alive = true;
+    this.started = false;
+    this.current = null;
+    this.buffer = Buffer.alloc(0);
+    this.process = spawn(CONVERTER_PATH, ['--daemon', '--framed', ...args], {
+      stdio: ['pipe', 'pipe', 'inherit']
+    });
+
+    // Fail the request that was running on this worker, then let the pool
+    // replace it. A worker that fails to start emits 'error' without 'exit'.
+    const finish = (reason) => {
+      if (!this.alive) {
+        return;
+      }
+      this.alive = false;
+      const current = this.current;
+      this.current = null;
+      if (current) {
+        clearTimeout(current.timer);
+        current.reject(new Error(`Converter worker exited (${reason})`));
+      }
+      onExit(this);
+    };
+
+    this.process.on('spawn', () => { this.started = true; });
+    this.process.stdout.on('data', (chunk) => this.onData(chunk));
+    this.process.on('error', (error) => finish(error.message));
+    this.process.on('exit', (code, signal) => finish(signal ?? code));
+    // Writes to a worker that has just died are reported through 'exit'.
+    this.process.stdin.on('error', () => {});
+  }
+
+  // Whether the worker can take a request now.
+  get idle() {
+    return this.alive && this.current === null;
+  }
+
+  // Send a request line to an idle worker and resolve with its status line.
+  // The converter enforces `timeout` itself by killing the job's forked
+  // child and its engine, and replies with an error. The timer here starts
+  // when the request is sent, not when it was queued.
+  send(id, request, timeout) {
+    return new Promise((resolve, reject) => {
+      const timer = setTimeout(() => {
+        this.current = null;
+        reject(new Error('Conversion timed out'));
+        this.process.kill('SIGKILL');
+      }, timeout + HUNG_WORKER_GRACE_MS);
+
+      this.current = { id, resolve, reject, timer };
+      this.process.stdin.write(frame(`${id}\t${request}`));
+    });
+  }
+
+  // Split the worker's output into frames and settle the current request.
+  onData(chunk) {
+    this.buffer = Buffer.concat([this.buffer, chunk]);
+    while (this.buffer.length >= 4) {
+      const length = this.buffer.readUInt32BE(0);
+      if (this.buffer.length < 4 + length) {
+        break;
+      }
+
+      const payload = this.buffer.toString('utf8', 4, 4 + length);
+      this.buffer = this.buffer.subarray(4 + length);
+
+      const tab = payload.indexOf('\t');
+      const id = payload.slice(0, tab);
+      const current = this.current;
+      if (current && current.id === id) {
+        this.current = null;
+        clearTimeout(current.timer);
+        current.resolve(payload.slice(tab + 1));
+      }
+    }
+  }
+}
+
+// A fixed set of converter workers that are restarted when they die.
+// Requests wait in one queue and each goes to the next idle worker, so a
+// request that arrives while every worker is restarting waits for one. The
+// queue is served shortest expected request first, like `convert --batch`:
+// every millisecond a request waits lowers its cost by one millisecond, so a
+// large upload is delayed behind smaller ones but never starved.
+class ConverterPool {
+  constructor(size, args = []) {
+    this.args = args;
+    this.startError = null;
+    this.nextId = 0;
+    this.queue = [];
+    this.workers = [];
+    for (let i = 0; i < size; i++) {
+      this.workers.push(this.startWorker());
+    }
+  }
+
+  startWorker() {
+    const worker = new ConverterWorker(this.args, (exited) => {
+      // A converter that cannot be started at all would leave the queue
+      // waiting for good, so fail what is queued until one starts again.
+      if (!exited.started && !this.workers.some((other) => other.alive)) {
+        this.startError = new Error('Converter worker could not be started');
+        for (const { reject } of this.queue.splice(0)) {
+          reject(this.startError);
+        }
+      }
+      // Back off briefly so a converter that cannot start does not spin.
+      const index = this.workers.indexOf(exited);
+      setTimeout(() => {
+        this.workers[index] = this.startWorker();
+        this.dispatch();
+      }, 1000);
+    });
+    worker.process.on('spawn', () => { this.startError = null; });
+    return worker;
+  }
+
+  // Remove and return the queued request with the lowest cost once its
+  // waiting time is taken off.
+  takeCheapest() {
+    const now = Date.now();
+    let best = 0;
+    for (let i = 1; i < this.queue.length; i++) {
+      const { cost, queuedAt } = this.queue[i];
+      if (cost - (now - queuedAt) < this.queue[best].cost - (now - this.queue[best].queuedAt)) {
+        best = i;
+      }
+    }
+    return this.queue.splice(best, 1)[0];
+  }
+
+  // Hand queued requests to idle workers.
+  dispatch() {
+    for (const worker of this.workers) {
+      if (this.queue.length === 0) {
+        return;
+      }
+      if (!worker.idle) {
+        continue;
+      }
+      const { request, timeout, resolve, reject } = this.takeCheapest();
+      worker
+        .send(String(this.nextId++), request, timeout)
+        .then(resolve, reject)
+        .finally(() => this.dispatch());
+    }
+  }
+
+  // Convert `docxPath` into `pdfPath`. Resolves with the daemon's OK status
+  // line and rejects with its ERR line or a worker failure. `timeout` counts
+  // from when a worker starts the conversion.
+  async convert(docxPath, pdfPath, { settings = '', timeout = 30000 } = {}) {
+    if (this.startError && !this.workers.some((worker) => worker.alive)) {
+      throw this.startError;
+    }
+
+    const allSettings = [settings, `timeout_ms=${timeout}`].filter(Boolean).join(',');
+    const bytes = await fs.promises.stat(docxPath).then((stats) => stats.size, () => 0);
+    const cost = BASE_COST_MS + (bytes / BYTES_PER_PAGE) * PAGE_COST_MS;
+    const status = await new Promise((resolve, reject) => {
+      const request = `${docxPath}\t${pdfPath}\t\t${allSettings}`;
+      this.queue.push({ request, timeout, cost, queuedAt: Date.now(), resolve, reject });
+      this.dispatch();
+    });
+    if (!status.startsWith('OK')) {
+      throw new Error(status);
+    }
+    return status;
+  }
+}
+
+module.exports = { ConverterPool };
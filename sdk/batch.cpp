@@ -0,0 +1,231 @@
+#include "batch.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "estimate.h"
+#include "job.h"
+#include "pool.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "worker.h"
+
+using namespace std;
+
+// Number of manifest rows read ahead of the running ones. Jobs inside this
+// window are run shortest expected job first.
+static const size_t kScheduleWindow = 256;
+
+// A manifest row that is currently being converted by a forked worker
+struct RunningRow
+{
+    int line;
+    int slot;
+    string input;
+    ForkedJob worker;
+};
+
+// Reads the next manifest row, skipping blank lines and comments
+static bool NextLine(ifstream &manifest, int &line_number, string &line)
+{
+    while (getline(manifest, line))
+    {
+        line_number++;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (!line.empty() && line[0] != '#')
+            return true;
+    }
+    return false;
+}
+
+// Writes one results row for a finished (or rejected) manifest row
+static void WriteResult(FILE *results, int line, const string &input, const ConversionResult &result)
+{
+    fprintf(results, "%d\t%s\t%s\n", line, input.c_str(), FormatResult(result).c_str());
+}
+
+// Reads and parses the next manifest row into `queued`, estimating its cost.
+// Rows that do not parse are reported straight to the results file and
+// counted in `failed`. Returns false at the end of the manifest.
+static bool NextRow(ifstream &manifest, int &line_number, FILE *results, QueuedJob &queued, int &failed)
+{
+    string line;
+    while (NextLine(manifest, line_number, line))
+    {
+        ConversionResult result;
+        if (ParseJobLine(line, queued.job, result.message))
+        {
+            queued.id = line_number;
+            queued.cost = EstimateCost(queued.job);
+            return true;
+        }
+
+        result.code = foxit::e_ErrParam;
+        WriteResult(results, line_number, line.substr(0, line.find('\t')), result);
+        failed++;
+    }
+    return false;
+}
+
+// Converts the manifest on an in-process WorkerPool. Returns the number of
+// rows that failed.
+static int RunThreaded(ifstream &manifest, FILE *results, const BatchOptions &options, int &converted)
+{
+    mutex results_mutex;
+    int failed = 0;
+    WorkerPool pool(options.threads, kScheduleWindow,
+                    [&](const QueuedJob &queued, const ConversionResult &result) {
+                        lock_guard<mutex> lock(results_mutex);
+                        WriteResult(results, queued.id, queued.job.input, result);
+                        fflush(results);
+                        if (result.code == foxit::e_ErrSuccess)
+                            converted++;
+                        else
+                            failed++;
+                    });
+
+    int line_number = 0;
+    QueuedJob queued;
+    for (;;)
+    {
+        bool more;
+        {
+            lock_guard<mutex> lock(results_mutex);
+            more = NextRow(manifest, line_number, results, queued, failed);
+        }
+        if (!more)
+            break;
+        pool.Submit(queued);
+    }
+
+    pool.Join();
+    pool.PrintUtilization(stderr);
+    return failed;
+}
+
+// Converts the manifest in forked workers, up to `jobs` at a time. Returns
+// the number of rows that failed.
+static int RunForked(ifstream &manifest, FILE *results, const BatchOptions &options, int &converted)
+{
+    int failed = 0;
+    int line_number = 0;
+    bool manifest_done = false;
+    vector<RunningRow> running;
+    // Worker slots not used by a running row, each owning a profile clone
+    vector<int> free_slots;
+    for (int slot = options.jobs - 1; slot >= 0; slot--)
+        free_slots.push_back(slot);
+
+    ShortestJobQueue pending;
+
+    while (!manifest_done || !pending.empty() || !running.empty())
+    {
+        // Read a window of rows ahead, lazily so that very long manifests
+        // are never held in memory, and start the cheapest ones first
+        QueuedJob queued;
+        while (!manifest_done && pending.size() < kScheduleWindow)
+        {
+            if (NextRow(manifest, line_number, results, queued, failed))
+                pending.Push(queued);
+            else
+                manifest_done = true;
+        }
+
+        while ((int)running.size() < options.jobs && pending.Pop(queued))
+        {
+            RunningRow row;
+            row.line = queued.id;
+            row.slot = free_slots.back();
+            row.input = queued.job.input;
+            string profile = options.profiles ? options.profiles->Checkout(row.slot) : "";
+            if (StartForkedJob(queued.job, row.worker, profile))
+            {
+                running.push_back(row);
+                free_slots.pop_back();
+                continue;
+            }
+
+            ConversionResult result;
+            result.code = foxit::e_ErrUnknown;
+            result.message = "fork failed";
+            WriteResult(results, row.line, row.input, result);
+            failed++;
+        }
+
+        if (running.empty())
+            continue;
+
+        // Wait for at least one worker to close its result pipe or run out
+        // of time, then collect every worker that has finished or timed out
+        vector<pollfd> fds(running.size());
+        int wait_ms = -1;
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            fds[i].fd = running[i].worker.result_fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+            int remaining_ms = RemainingMs(running[i].worker);
+            if (remaining_ms >= 0 && (wait_ms < 0 || remaining_ms < wait_ms))
+                wait_ms = remaining_ms;
+        }
+        if (poll(&fds[0], fds.size(), wait_ms) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            failed += running.size();
+            break;
+        }
+
+        for (size_t i = fds.size(); i-- > 0;)
+        {
+            if (fds[i].revents == 0 && RemainingMs(running[i].worker) != 0)
+                continue;
+
+            ConversionResult result = FinishForkedJob(running[i].worker);
+            WriteResult(results, running[i].line, running[i].input, result);
+            if (result.code == foxit::e_ErrSuccess)
+                converted++;
+            else
+                failed++;
+            if (options.profiles)
+                options.profiles->Reset(running[i].slot);
+            free_slots.push_back(running[i].slot);
+            running.erase(running.begin() + i);
+        }
+        fflush(results);
+    }
+    return failed;
+}
+
+int RunBatch(const BatchOptions &options)
+{
+    ifstream manifest(options.manifest.c_str());
+    if (!manifest)
+    {
+        fprintf(stderr, "cannot open manifest %s\n", options.manifest.c_str());
+        return 1;
+    }
+    FILE *results = fopen(options.results.c_str(), "w");
+    if (!results)
+    {
+        fprintf(stderr, "cannot open results file %s\n", options.results.c_str());
+        return 1;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int converted = 0;
+    int failed = TotalThreads(options.threads) > 0 ? RunThreaded(manifest, results, options, converted)
+                                     : RunForked(manifest, results, options, converted);
+
+    fclose(results);
+    double elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "batch finished: %d converted, %d failed in %.1f ms\n", converted, failed, elapsed_ms);
+    return failed == 0 ? 0 : 1;
+}
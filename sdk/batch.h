@@ -0,0 +1,38 @@
+#ifndef CONVERT_BATCH_H_
+#define CONVERT_BATCH_H_
+
+#include <string>
+
+#include "pool.h"
+
+class ProfileCache;
+
+// Settings for converting every row of a manifest in one process.
+struct BatchOptions
+{
+    // Manifest with one tab separated row per document, in the same
+    // "<input>\t<output>[\t<password>[\t<settings>]]" format as daemon
+    // requests. Blank lines and lines starting with '#' are skipped.
+    std::string manifest;
+    // File receiving one "<line>\t<input>\t<status>" row per manifest row, in
+    // completion order, where <status> is the daemon's OK/ERR status line.
+    std::string results;
+    // Maximum number of conversions running at the same time.
+    int jobs;
+    // When any count is non-zero, convert on an in-process WorkerPool with
+    // these per-format threads instead of in forked workers.
+    ThreadCounts threads;
+    // When set, each forked worker slot converts against its own clone of
+    // the golden engine profile, reset after every row.
+    ProfileCache *profiles;
+
+    BatchOptions() : jobs(1), threads(kFormatCount + 1, 0), profiles(NULL) {}
+};
+
+// Converts every row of the manifest, each in a child forked from this
+// initialized process or, with `threads` set, on an in-process WorkerPool
+// whose per-format pool utilization is printed to stderr at the end. Returns non-zero if the manifest or results file could
+// not be opened or any row failed.
+int RunBatch(const BatchOptions &options);
+
+#endif  // CONVERT_BATCH_H_
@@ -0,0 +1,196 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clone.h"
+#include "sha256.h"
+
+using namespace std;
+
+// Eviction trims the cache to this share of its limit, so that it does not
+// run again on every publish once the cache is full
+static const double kEvictToRatio = 0.9;
+// Scratch copies older than this were left behind by a worker that died
+static const time_t kStaleScratchSeconds = 3600;
+
+ResultCache::ResultCache(const string &root, long long max_bytes, const string &version)
+    : root_(root), max_bytes_(max_bytes), version_(version)
+{
+    mkdir(root_.c_str(), 0755);
+}
+
+// Hashes `field` after its length, so that no two sequences of fields hash
+// the same bytes whatever characters they contain
+static void HashField(Sha256 &hash, const string &field)
+{
+    char length[32];
+    snprintf(length, sizeof(length), "%zu:", field.size());
+    hash.Update(string(length));
+    hash.Update(field);
+}
+
+bool ResultCache::Key(const ConversionJob &job, string &key) const
+{
+    ifstream input(job.input.c_str(), ios::binary);
+    if (!input)
+        return false;
+
+    Sha256 hash;
+    HashField(hash, version_);
+    HashField(hash, SettingsKey(job));
+    HashField(hash, job.password);
+
+    char buffer[65536];
+    while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0)
+        hash.Update(buffer, input.gcount());
+    if (input.bad())
+        return false;
+
+    key = hash.HexDigest();
+    return true;
+}
+
+int ResultCache::Open(const string &key) const
+{
+    int fd = open(EntryPath(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    // The modification time doubles as the last use for eviction
+    futimens(fd, NULL);
+    return fd;
+}
+
+int ResultCache::Lock(const string &key) const
+{
+    string path = root_ + "/" + key + ".lock";
+    for (;;)
+    {
+        int lock = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock < 0)
+            return -1;
+        int status;
+        while ((status = flock(lock, LOCK_EX)) < 0 && errno == EINTR)
+            ;
+
+        // The previous holder removes the file before releasing it, so the
+        // lock only counts if the file is still the one at `path`
+        struct stat held, current;
+        if (status == 0 && fstat(lock, &held) == 0 && stat(path.c_str(), &current) == 0 &&
+            held.st_ino == current.st_ino && held.st_dev == current.st_dev)
+            return lock;
+        close(lock);
+        if (status < 0)
+            return -1;
+    }
+}
+
+void ResultCache::Unlock(const string &key, int lock) const
+{
+    unlink((root_ + "/" + key + ".lock").c_str());
+    close(lock);
+}
+
+void ResultCache::Publish(const string &key, const string &pdf) const
+{
+    int in = open(pdf.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return;
+
+    string scratch = root_ + "/.publish-XXXXXX";
+    int out = mkstemp(&scratch[0]);
+    if (out < 0)
+    {
+        close(in);
+        return;
+    }
+
+    bool ok = CloneData(in, out) && fchmod(out, 0644) == 0;
+    close(in);
+    if (close(out) < 0)
+        ok = false;
+
+    // Readers either find the whole entry or none at all
+    if (!ok || rename(scratch.c_str(), EntryPath(key).c_str()) < 0)
+    {
+        unlink(scratch.c_str());
+        return;
+    }
+    Evict();
+}
+
+string ResultCache::EntryPath(const string &key) const
+{
+    return root_ + "/" + key + ".pdf";
+}
+
+void ResultCache::Evict() const
+{
+    // One evictor at a time is enough; the others skip rather than wait
+    int lock = open((root_ + "/.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock < 0)
+        return;
+    if (flock(lock, LOCK_EX | LOCK_NB) < 0)
+    {
+        close(lock);
+        return;
+    }
+
+    DIR *directory = opendir(root_.c_str());
+    if (!directory)
+    {
+        close(lock);
+        return;
+    }
+
+    vector<pair<time_t, string> > entries;
+    long long total = 0;
+    time_t now = time(NULL);
+    while (dirent *entry = readdir(directory))
+    {
+        string name = entry->d_name;
+        string path = root_ + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) < 0 || !S_ISREG(info.st_mode))
+            continue;
+
+        if (name.compare(0, 9, ".publish-") == 0)
+        {
+            if (now - info.st_mtime > kStaleScratchSeconds)
+                unlink(path.c_str());
+            continue;
+        }
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".pdf") != 0)
+            continue;
+
+        entries.push_back(make_pair(info.st_mtime, path));
+        total += info.st_size;
+    }
+    closedir(directory);
+
+    if (total > max_bytes_)
+    {
+        sort(entries.begin(), entries.end());
+        long long target = (long long)(max_bytes_ * kEvictToRatio);
+        for (size_t i = 0; i < entries.size() && total > target; i++)
+        {
+            struct stat info;
+            if (stat(entries[i].second.c_str(), &info) == 0 && unlink(entries[i].second.c_str()) == 0)
+                total -= info.st_size;
+        }
+    }
+    close(lock);
+}
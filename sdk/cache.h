@@ -0,0 +1,54 @@
+#ifndef CONVERT_CACHE_H_
+#define CONVERT_CACHE_H_
+
+#include <string>
+
+#include "job.h"
+
+// Keeps converted PDFs on local disk, named by a hash of everything that
+// decides their content: the input bytes, the job's format, settings and
+// password, and the SDK and engine builds. A repeated upload is answered
+// from disk without starting the engine.
+//
+// Entries are published with an atomic rename, so concurrent workers, be
+// they threads or forked processes, never see a half-written PDF. Once the
+// cache grows past its size limit the least recently used entries are evicted.
+class ResultCache
+{
+public:
+    // Entries live directly under `root`. `version` identifies the converter
+    // build and is mixed into every key.
+    ResultCache(const std::string &root, long long max_bytes, const std::string &version);
+
+    // Computes the key for `job` by hashing its input document. Returns false
+    // if the input cannot be read.
+    bool Key(const ConversionJob &job, std::string &key) const;
+
+    // Opens the entry for `key` for reading and marks it as recently used.
+    // Returns -1 on a miss. An open entry stays readable even if it is
+    // evicted meanwhile.
+    int Open(const std::string &key) const;
+
+    // Takes the lock for `key`, waiting while another thread or process holds
+    // it. Holding the lock while converting makes identical jobs that arrive
+    // meanwhile wait for that one conversion and then find its PDF, instead of
+    // each starting the engine. Returns a descriptor for Unlock, or -1.
+    int Lock(const std::string &key) const;
+
+    // Releases a lock taken with Lock.
+    void Unlock(const std::string &key, int lock) const;
+
+    // Copies the PDF at `pdf` into the cache under `key`, then evicts least
+    // recently used entries if the cache is over its limit.
+    void Publish(const std::string &key, const std::string &pdf) const;
+
+private:
+    std::string EntryPath(const std::string &key) const;
+    void Evict() const;
+
+    std::string root_;
+    long long max_bytes_;
+    std::string version_;
+};
+
+#endif  // CONVERT_CACHE_H_
@@ -0,0 +1,43 @@
+#include "clone.h"
+
+#include <string>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using namespace std;
+
+bool CloneData(int in, int out)
+{
+    if (ioctl(out, FICLONE, in) == 0)
+        return true;
+
+    char buffer[65536];
+    ssize_t count;
+    while ((count = read(in, buffer, sizeof(buffer))) > 0)
+    {
+        if (write(out, buffer, count) != count)
+            return false;
+    }
+    return count == 0;
+}
+
+bool CloneFile(const string &from, const string &to, mode_t mode)
+{
+    int in = open(from.c_str(), O_RDONLY);
+    if (in < 0)
+        return false;
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode & 0777);
+    if (out < 0)
+    {
+        close(in);
+        return false;
+    }
+
+    bool ok = CloneData(in, out);
+    close(in);
+    close(out);
+    return ok;
+}
@@ -0,0 +1,17 @@
+#ifndef CONVERT_CLONE_H_
+#define CONVERT_CLONE_H_
+
+#include <string>
+
+#include <sys/types.h>
+
+// Copies everything readable from `in` to the start of `out`, sharing extents
+// with a reflink when both are on a file system that supports it. Hard links
+// are deliberately not used anywhere: the copy may be rewritten in place,
+// which would change the original too.
+bool CloneData(int in, int out);
+
+// Copies the regular file `from` to `to`, created with permissions `mode`.
+bool CloneFile(const std::string &from, const std::string &to, mode_t mode);
+
+#endif  // CONVERT_CLONE_H_
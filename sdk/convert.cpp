@@ -1,47 +1,330 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
 #include <iostream>
-#include <locale>
-#include <codecvt>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "common/fs_common.h"
 #include "addon/conversion/fs_convert.h"
+#include "job.h"
+#include "daemon.h"
+#include "batch.h"
+#include "cache.h"
+#include "pdfa.h"
+#include "profile.h"
+#include "stream.h"
+#include "text.h"
+#include "thumbnails.h"
 using namespace std;
 using namespace foxit;
-using namespace common;
-using namespace pdf;
 using namespace foxit::common;
 using namespace foxit::addon::conversion;
 
+// How long this process had been running when main() was entered. This
+// covers exec and the dynamic loader mapping and relocating
+// libfsdk_linux64.so. The kernel records process start times in clock
+// ticks, so the value is only accurate to about 10 ms.
+static double ProcessAgeMs()
+{
+    ifstream stat("/proc/self/stat");
+    string contents;
+    getline(stat, contents);
+
+    // Field 22 is the start time; skip past the parenthesised command name
+    // first as it may itself contain spaces
+    string::size_type position = contents.rfind(')');
+    if (position == string::npos)
+        return 0;
+    istringstream fields(contents.substr(position + 2));
+    string field;
+    for (int i = 3; i <= 22 && fields >> field; i++)
+        ;
+
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    double started_ms = atof(field.c_str()) * 1000.0 / sysconf(_SC_CLK_TCK);
+    double now_ms = now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+    return now_ms > started_ms ? now_ms - started_ms : 0;
+}
+
+// Durations of the fixed start-up and shutdown phases of this process, in
+// milliseconds. Negative values mark phases that did not run.
+struct StartupTimings
+{
+    double load_ms;
+    double init_ms;
+    double first_convert_ms;
+    double release_ms;
+
+    StartupTimings() : load_ms(-1), init_ms(-1), first_convert_ms(-1), release_ms(-1) {}
+};
+
+// Prints the timings as one "timings name=value..." line on stderr
+static void PrintTimings(const StartupTimings &timings)
+{
+    ConversionResult line;
+    if (timings.load_ms >= 0)
+        AddStat(line, "load_ms", timings.load_ms);
+    if (timings.init_ms >= 0)
+        AddStat(line, "init_ms", timings.init_ms);
+    if (timings.first_convert_ms >= 0)
+        AddStat(line, "first_convert_ms", timings.first_convert_ms);
+    if (timings.release_ms >= 0)
+        AddStat(line, "release_ms", timings.release_ms);
+    fprintf(stderr, "timings%s\n", line.stats.c_str());
+}
+
+static void PrintUsage(const char *program)
+{
+    cerr << "Usage:" << endl
+         << "  " << program << " <input> <output.pdf> [settings]" << endl
+         << "  " << program << " --daemon [--fork] [--framed] [--socket <path>]" << endl
+         << "  " << program << " --batch <manifest.tsv> <results.tsv> [--jobs <n> | --threads <n|word=n,excel=n,...>]" << endl
+         << "Options:" << endl
+         << "  --engine <path>    LibreOffice program directory (default $FOXIT_ENGINE_PATH)" << endl
+         << "  --profiles <dir>   give each forked worker a clone of a golden engine profile" << endl
+         << "  --cache <dir>      reuse PDFs converted earlier from identical input and settings" << endl
+         << "  --cache-size <mb>  evict least recently used cached PDFs beyond this size (default 1024)" << endl
+         << "  --stream-from <mb> read converted PDFs this large from disk on demand when re-saving (default 256)" << endl
+         << "  --compliance <dir> compliance engine resources, needed for pdfa= settings" << endl
+         << "  --render-threads <n> threads rendering each job's thumbnails (default 1)" << endl
+         << "  --text-threads <n> threads extracting each job's text (default 1)" << endl
+         << "  --warmup <docx>    sample document converted before any job is run" << endl
+         << "  --timings          print start-up phase durations to stderr on exit" << endl
+         << "  --lean             skip SDK features Word conversion does not use" << endl;
+}
+
 int main(int argc, char *argv[])
 {
+    StartupTimings timings;
+    timings.load_ms = ProcessAgeMs();
+
+    bool daemon = false;
+    bool print_timings = false;
+    bool lean = false;
+    bool batch = false;
+    DaemonOptions daemon_options;
+    BatchOptions batch_options;
+    string socket_path;
+    string warmup_document;
+    string profile_root;
+    string cache_root;
+    string compliance_root;
+    long long cache_mb = 1024;
+    long long stream_mb = 256;
+    int render_threads = 1;
+    int text_threads = 1;
+    vector<string> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--daemon") == 0)
+            daemon = true;
+        else if (strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+            batch_options.jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            if (!ParseThreadCounts(argv[++i], batch_options.threads))
+            {
+                PrintUsage(argv[0]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--fork") == 0)
+            daemon_options.fork_per_job = true;
+        else if (strcmp(argv[i], "--framed") == 0)
+            daemon_options.framed = true;
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+            socket_path = argv[++i];
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmup_document = argv[++i];
+        else if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc)
+            profile_root = argv[++i];
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cache_root = argv[++i];
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            cache_mb = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--stream-from") == 0 && i + 1 < argc)
+            stream_mb = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--compliance") == 0 && i + 1 < argc)
+            compliance_root = argv[++i];
+        else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc)
+            render_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--text-threads") == 0 && i + 1 < argc)
+            text_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+            SetEnginePath(argv[++i]);
+        else if (strcmp(argv[i], "--timings") == 0)
+            print_timings = true;
+        else if (strcmp(argv[i], "--lean") == 0)
+            lean = true;
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+        else
+            positional.push_back(argv[i]);
+    }
+
+    // Profile clones are handed to forked workers through the environment,
+    // so they cannot be combined with in-process threads
+    bool valid;
+    if (daemon)
+        valid = !batch && positional.empty() && (profile_root.empty() || daemon_options.fork_per_job);
+    else if (batch)
+        valid = positional.size() == 2 && !daemon_options.framed && batch_options.jobs > 0 &&
+                (profile_root.empty() || TotalThreads(batch_options.threads) == 0);
+    else
+        valid = (positional.size() == 2 || positional.size() == 3) && !daemon_options.fork_per_job && !daemon_options.framed &&
+                socket_path.empty() && warmup_document.empty() && profile_root.empty();
+    if (cache_mb <= 0 || stream_mb <= 0 || render_threads <= 0 || text_threads <= 0)
+        valid = false;
+    if (!valid)
+    {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+    SetStreamedReads(stream_mb * 1024 * 1024);
+    SetRenderThreads(render_threads);
+    SetTextThreads(text_threads);
+
     // Retrieve Foxit license details from environment variables
     const char *sn = std::getenv("FOXIT_SN");
     const char *key = std::getenv("FOXIT_KEY");
 
-    // Initialize the library before using it
+    // Initialize the library before using it. In daemon mode this happens
+    // once for the lifetime of the process rather than once per document.
+    chrono::steady_clock::time_point init_start = chrono::steady_clock::now();
     foxit::ErrorCode code = Library::Initialize(sn, key);
+    timings.init_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - init_start).count();
+    daemon_options.init_ms = timings.init_ms;
     if (code != foxit::e_ErrSuccess)
     {
-        return FALSE;
+        cerr << "Library::Initialize failed with error " << code << endl;
+        return 1;
     }
 
-    // Get the parameters for the conversion
-    Word2PDFSettingData word2PdfSettingData;
-    // The first positional command line parameter contains the DOCX file path
-    WString doc;
-    doc.ConvertFrom(argv[1]);
-    // The second positional command line parameter contains the PDF file's desired path
-    WString pdf;          
-    pdf.ConvertFrom(argv[2]);
+    // Add-on modules (OCR, compliance, ...) are only set up when first used,
+    // but the PDF JavaScript engine is enabled by default. Word conversion
+    // never runs PDF JavaScript, so --lean turns it off.
+    if (lean)
+        Library::EnableJavaScript(false);
+
+    // The compliance engine is set up once here like the library, so PDF/A
+    // jobs do not each pay for loading its resources
+    if (!compliance_root.empty())
+    {
+        const char *unlock_code = std::getenv("FOXIT_COMPLIANCE_CODE");
+        code = InitializePdfa(compliance_root, unlock_code ? unlock_code : "");
+        if (code != foxit::e_ErrSuccess)
+        {
+            cerr << "ComplianceEngine::Initialize failed with error " << code << endl;
+            Library::Release();
+            return 1;
+        }
+    }
+
+    // Conversions running on several threads of this process share the
+    // library, which has to be told to guard its internal state. So do
+    // thumbnail render and text threads.
+    if (TotalThreads(batch_options.threads) > 0 || render_threads > 1 || text_threads > 1)
+        Library::EnableThreadSafety(true);
+
+    // With a profile cache the warm-up document builds the golden profile
+    // instead of warming the default one
+    ProfileCache profiles(profile_root);
+    if (!profile_root.empty())
+    {
+        if (!profiles.EnsureGolden(warmup_document))
+        {
+            Library::Release();
+            return 1;
+        }
+        daemon_options.profiles = &profiles;
+        batch_options.profiles = &profiles;
+    }
+    else if (daemon || batch)
+    {
+        ConversionResult warmup = WarmUp(warmup_document);
+        if (!warmup_document.empty())
+            timings.first_convert_ms = warmup.elapsed_ms;
+    }
+    daemon_options.warmup_document = warmup_document;
+
+    // Set up the result cache once warm-up is done; forked workers and threads share it
+    ResultCache *cache = NULL;
+    if (!cache_root.empty())
+    {
+        cache = new ResultCache(cache_root, cache_mb * 1024 * 1024, ConverterVersion());
+        SetResultCache(cache);
+    }
+
+    int exit_code = 0;
+    if (daemon)
+    {
+        // Serve conversion requests until stdin is closed or the socket fails.
+        // With --fork every job runs in a child of this initialized process.
+        if (socket_path.empty())
+            ServeStream(STDIN_FILENO, STDOUT_FILENO, daemon_options);
+        else
+            exit_code = ServeSocket(socket_path, daemon_options);
+    }
+    else if (batch)
+    {
+        // Convert every manifest row with this single initialized library,
+        // running up to --jobs forked workers or --threads threads at a time
+        batch_options.manifest = positional[0];
+        batch_options.results = positional[1];
+        exit_code = RunBatch(batch_options);
+    }
+    else
+    {
+        // The first positional command line parameter contains the source document path,
+        // the second the PDF file's desired path and the optional third the settings
+        ConversionJob job;
+        job.input = positional[0];
+        job.output = positional[1];
+        job.format = FormatFromPath(job.input);
+
+        string error;
+        ConversionResult result;
+        if (!ParseSettings(positional.size() > 2 ? positional[2] : "", job, error))
+        {
+            result.code = e_ErrParam;
+            result.message = error;
+        }
+        else
+        {
+            result = RunJob(job);
+            timings.first_convert_ms = result.elapsed_ms;
+        }
+
+        if (result.code != e_ErrSuccess)
+        {
+            cerr << FormatResult(result) << endl;
+            exit_code = 1;
+        }
+    }
 
-    // Convert the document
-    Convert::FromWord(doc, L"", pdf, L"/opt/libreoffice6.4/program", word2PdfSettingData);
+    SetResultCache(NULL);
+    delete cache;
+    ReleasePdfa();
 
     // Release the library when finished
+    chrono::steady_clock::time_point release_start = chrono::steady_clock::now();
     Library::Release();
+    timings.release_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - release_start).count();
 
-    // Exit with 0 to signify everything executed successfully
-    exit(0);
-}
\ No newline at end of file
+    if (print_timings)
+        PrintTimings(timings);
+    return exit_code;
+}
@@ -0,0 +1,259 @@
+#include "daemon.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "job.h"
+#include "profile.h"
+#include "worker.h"
+
+using namespace std;
+
+// Largest framed request accepted, to stop a corrupt length from making the
+// daemon buffer without bound
+static const uint32_t kMaxFrameSize = 1 << 20;
+
+// Buffers reads from a file descriptor and hands them out one request at a
+// time, either as newline terminated lines or as frames carrying a 4-byte
+// big-endian length followed by that many bytes of payload
+class RequestReader
+{
+public:
+    RequestReader(int fd, bool framed) : fd_(fd), framed_(framed) {}
+
+    // Returns false once the descriptor is exhausted (or a frame is corrupt)
+    // and no complete request remains
+    bool Next(string &request)
+    {
+        for (;;)
+        {
+            if (framed_ ? TakeFrame(request) : TakeLine(request))
+                return true;
+            if (framed_ && buffer_.size() >= 4 && FrameSize() > kMaxFrameSize)
+                return false;
+
+            char chunk[4096];
+            ssize_t count = read(fd_, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+            {
+                // A final line may lack its newline; a partial frame is dropped
+                if (framed_ || buffer_.empty())
+                    return false;
+                request.swap(buffer_);
+                buffer_.clear();
+                return true;
+            }
+            buffer_.append(chunk, count);
+        }
+    }
+
+private:
+    bool TakeLine(string &line)
+    {
+        string::size_type newline = buffer_.find('\n');
+        if (newline == string::npos)
+            return false;
+        line = buffer_.substr(0, newline);
+        buffer_.erase(0, newline + 1);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        return true;
+    }
+
+    bool TakeFrame(string &payload)
+    {
+        if (buffer_.size() < 4 || FrameSize() > kMaxFrameSize || buffer_.size() < 4 + FrameSize())
+            return false;
+        payload = buffer_.substr(4, FrameSize());
+        buffer_.erase(0, 4 + payload.size());
+        return true;
+    }
+
+    uint32_t FrameSize() const
+    {
+        const unsigned char *bytes = (const unsigned char *)buffer_.data();
+        return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    }
+
+    int fd_;
+    bool framed_;
+    string buffer_;
+};
+
+// Writes the whole buffer, retrying on short writes and interrupts
+static bool WriteAll(int fd, const string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t count = write(fd, data.data() + written, data.size() - written);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        written += count;
+    }
+    return true;
+}
+
+static void LogWarmUp(const ConversionResult &result)
+{
+    if (result.code == foxit::e_ErrSuccess)
+        fprintf(stderr, "engine warm-up took %.1f ms\n", result.elapsed_ms);
+    else
+        fprintf(stderr, "engine warm-up failed: %s\n", FormatResult(result).c_str());
+}
+
+ConversionResult WarmUp(const string &document)
+{
+    if (document.empty())
+        return ConversionResult();
+
+    ConversionResult result = WarmUpEngine(document);
+    LogWarmUp(result);
+    return result;
+}
+
+// Warms the engine up again after a forked job died. This runs in a child
+// against the slot's profile like the jobs do: the daemon's own engine did
+// not crash, and warming it here would give up the isolation forking gives.
+static void WarmUpForked(const DaemonOptions &options)
+{
+    if (options.warmup_document.empty())
+        return;
+
+    string profile = options.profiles ? options.profiles->Checkout(0) : "";
+    LogWarmUp(RunForkedWarmUp(options.warmup_document, profile));
+    if (options.profiles)
+        options.profiles->Reset(0);
+}
+
+// Prefixes `payload` with its 4-byte big-endian length
+static string Frame(const string &payload)
+{
+    uint32_t size = payload.size();
+    char header[4] = {(char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size};
+    return string(header, 4) + payload;
+}
+
+void ServeStream(int in_fd, int out_fd, const DaemonOptions &options)
+{
+    RequestReader reader(in_fd, options.framed);
+    string line;
+    while (reader.Next(line))
+    {
+        // Framed requests start with a client chosen id that is echoed back
+        // so that the client can match replies to requests
+        string id;
+        if (options.framed)
+        {
+            string::size_type tab = line.find('\t');
+            id = line.substr(0, tab);
+            line = tab == string::npos ? "" : line.substr(tab + 1);
+        }
+        else if (line.empty())
+            continue;
+
+        ConversionJob job;
+        ConversionResult result;
+        if (!ParseJobLine(line, job, result.message))
+            result.code = foxit::e_ErrParam;
+        else
+        {
+            if (!options.fork_per_job)
+                result = RunJob(job);
+            else if (!options.profiles)
+                result = RunForkedJob(job);
+            else
+                result = RunForkedJob(job, options.profiles->Checkout(0));
+            AddStat(result, "saved_ms", options.init_ms);
+        }
+
+        string reply = options.framed ? Frame(id + "\t" + FormatResult(result)) : FormatResult(result) + "\n";
+        if (!WriteAll(out_fd, reply))
+            return;
+
+        // Reset the profile after replying so the client does not wait for it
+        if (options.fork_per_job && options.profiles)
+            options.profiles->Reset(0);
+
+        // Bring a fresh engine up after it died mid-conversion, now rather
+        // than on the next request. Failures of the converter's own stages
+        // have codes of their own and do not count. Without --fork the SDK
+        // reporting an unknown error is the only sign of an engine crash.
+        if (options.fork_per_job && result.code == kErrWorkerDied)
+            WarmUpForked(options);
+        else if (!options.fork_per_job && result.code == foxit::e_ErrUnknown)
+            WarmUp(options.warmup_document);
+    }
+}
+
+int ServeSocket(const string &path, const DaemonOptions &options)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "socket path too long: %s\n", path.c_str());
+        return 1;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    // Neither the listener nor a connection may leak into forked jobs or the
+    // engine processes they start
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    // Remove a stale socket left behind by a previous run, but never anything
+    // else that happens to be at the path
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0)
+    {
+        if (!S_ISSOCK(existing.st_mode))
+        {
+            fprintf(stderr, "not a socket, refusing to replace: %s\n", path.c_str());
+            close(listener);
+            return 1;
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 16) < 0)
+    {
+        perror("bind");
+        close(listener);
+        return 1;
+    }
+
+    for (;;)
+    {
+        int connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (connection < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            break;
+        }
+        ServeStream(connection, connection, options);
+        close(connection);
+    }
+
+    close(listener);
+    unlink(path.c_str());
+    return 1;
+}
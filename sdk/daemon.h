@@ -0,0 +1,51 @@
+#ifndef CONVERT_DAEMON_H_
+#define CONVERT_DAEMON_H_
+
+#include <string>
+
+#include "job.h"
+
+class ProfileCache;
+
+// How the daemon runs the requests it receives.
+struct DaemonOptions
+{
+    // Run each job in a child forked from the initialized daemon (zygote
+    // mode) instead of in the daemon process itself.
+    bool fork_per_job;
+    // Time the daemon spent in Library::Initialize. Every request served
+    // saves at least this much compared with starting a fresh process, and
+    // it is reported as "saved_ms" on each OK status line.
+    double init_ms;
+    // Word document converted at startup, and again after a job crashes the
+    // engine, so that LibreOffice start-up is not paid by the next request.
+    // With fork_per_job the repeat runs in a forked child against the slot's
+    // profile.
+    std::string warmup_document;
+    // When set, forked jobs run against a private clone of the golden
+    // engine profile that is reset after every job.
+    ProfileCache *profiles;
+    // Exchange length-prefixed frames instead of lines. Each request frame
+    // is "<id>\t<request line>" and each reply frame "<id>\t<status line>",
+    // where every frame starts with its payload size as a 4-byte big-endian
+    // integer.
+    bool framed;
+
+    DaemonOptions() : fork_per_job(false), init_ms(0), profiles(NULL), framed(false) {}
+};
+
+// Converts `document`, if one is given, as a warm-up and logs its duration.
+// Returns the warm-up's result, or a zero-time success when there is none.
+ConversionResult WarmUp(const std::string &document);
+
+// Reads one request at a time from `in_fd`, converts it and writes a single
+// status reply per request to `out_fd`. Returns when the input reaches
+// end of file. The library must already be initialized.
+void ServeStream(int in_fd, int out_fd, const DaemonOptions &options);
+
+// Listens on a Unix domain socket at `path` and serves each accepted
+// connection with ServeStream, one connection at a time. Returns non-zero if
+// the socket could not be set up.
+int ServeSocket(const std::string &path, const DaemonOptions &options);
+
+#endif  // CONVERT_DAEMON_H_
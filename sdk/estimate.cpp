@@ -0,0 +1,157 @@
+#include "estimate.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <zlib.h>
+
+using namespace std;
+
+// Largest docProps/app.xml we are prepared to inflate
+static const uint32_t kMaxAppXmlSize = 1 << 20;
+
+// Fixed engine cost per format, and per page (or slide) once known, in
+// milliseconds. These only need to rank jobs, not predict them exactly.
+static const double kBaseCostMs[kFormatCount] = {800, 1000, 1200, 50};
+static const double kPageCostMs = 150;
+// Used to guess a page count when app.xml has none
+static const double kWordsPerPage = 500;
+static const double kBytesPerPage = 25000;
+
+static uint32_t ReadLE(const unsigned char *bytes, int size)
+{
+    uint32_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+// Extracts docProps/app.xml from a zip package by walking its central
+// directory. Returns an empty string if the entry is missing or unreadable.
+static string ReadAppXml(ifstream &file, long long size)
+{
+    // The end of central directory record sits in the last 64 KiB + 22 bytes
+    long long tail_size = size < 65557 ? size : 65557;
+    vector<unsigned char> tail(tail_size);
+    file.seekg(size - tail_size);
+    if (tail_size < 22 || !file.read((char *)&tail[0], tail_size))
+        return "";
+
+    long long eocd = -1;
+    for (long long i = tail_size - 22; i >= 0; i--)
+    {
+        if (ReadLE(&tail[i], 4) == 0x06054b50)
+        {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0)
+        return "";
+
+    uint32_t directory_size = ReadLE(&tail[eocd + 12], 4);
+    uint32_t directory_offset = ReadLE(&tail[eocd + 16], 4);
+    if (directory_size == 0 || (long long)directory_offset + directory_size > size)
+        return "";
+
+    vector<unsigned char> directory(directory_size);
+    file.seekg(directory_offset);
+    if (!file.read((char *)&directory[0], directory_size))
+        return "";
+
+    static const char kName[] = "docProps/app.xml";
+    for (uint32_t at = 0; at + 46 <= directory_size && ReadLE(&directory[at], 4) == 0x02014b50;)
+    {
+        uint32_t method = ReadLE(&directory[at + 10], 2);
+        uint32_t compressed = ReadLE(&directory[at + 20], 4);
+        uint32_t uncompressed = ReadLE(&directory[at + 24], 4);
+        uint32_t name_length = ReadLE(&directory[at + 28], 2);
+        uint32_t extra_length = ReadLE(&directory[at + 30], 2);
+        uint32_t comment_length = ReadLE(&directory[at + 32], 2);
+        uint32_t local_offset = ReadLE(&directory[at + 42], 4);
+
+        if (at + 46 + name_length <= directory_size && name_length == sizeof(kName) - 1 &&
+            memcmp(&directory[at + 46], kName, name_length) == 0)
+        {
+            if ((method != 0 && method != 8) || uncompressed > kMaxAppXmlSize || compressed > kMaxAppXmlSize)
+                return "";
+
+            // The local header repeats the name and has its own extra field
+            unsigned char local[30];
+            file.seekg(local_offset);
+            if (!file.read((char *)local, sizeof(local)) || ReadLE(local, 4) != 0x04034b50)
+                return "";
+            file.seekg(local_offset + 30 + ReadLE(&local[26], 2) + ReadLE(&local[28], 2));
+
+            string data(compressed, '\0');
+            if (compressed > 0 && !file.read(&data[0], compressed))
+                return "";
+            if (method == 0)
+                return data;
+
+            string xml(uncompressed, '\0');
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                return "";
+            stream.next_in = (Bytef *)&data[0];
+            stream.avail_in = compressed;
+            stream.next_out = (Bytef *)&xml[0];
+            stream.avail_out = uncompressed;
+            int status = inflate(&stream, Z_FINISH);
+            inflateEnd(&stream);
+            return status == Z_STREAM_END ? xml : "";
+        }
+        at += 46 + name_length + extra_length + comment_length;
+    }
+    return "";
+}
+
+// Returns the integer inside <tag>...</tag>, or -1 if it is absent
+static int ReadCount(const string &xml, const char *tag)
+{
+    string open = string("<") + tag + ">";
+    string::size_type start = xml.find(open);
+    if (start == string::npos)
+        return -1;
+    return atoi(xml.c_str() + start + open.size());
+}
+
+DocumentStats ReadDocumentStats(const string &path)
+{
+    DocumentStats stats;
+    ifstream file(path.c_str(), ios::binary | ios::ate);
+    if (!file)
+        return stats;
+    stats.bytes = file.tellg();
+
+    string xml = ReadAppXml(file, stats.bytes);
+    if (!xml.empty())
+    {
+        stats.pages = ReadCount(xml, "Pages");
+        stats.words = ReadCount(xml, "Words");
+        stats.slides = ReadCount(xml, "Slides");
+    }
+    return stats;
+}
+
+double EstimateCost(const ConversionJob &job)
+{
+    DocumentStats stats = ReadDocumentStats(job.input);
+
+    double pages;
+    if (stats.pages > 0)
+        pages = stats.pages;
+    else if (stats.slides > 0)
+        pages = stats.slides;
+    else if (stats.words > 0)
+        pages = stats.words / kWordsPerPage;
+    else
+        pages = stats.bytes / kBytesPerPage;
+
+    return kBaseCostMs[job.format] + pages * kPageCostMs;
+}
@@ -0,0 +1,27 @@
+#ifndef CONVERT_ESTIMATE_H_
+#define CONVERT_ESTIMATE_H_
+
+#include "job.h"
+
+// Cheap facts about a source document, read without starting an engine.
+struct DocumentStats
+{
+    long long bytes;
+    // Counts from docProps/app.xml in Office Open XML packages, or -1 when
+    // the document does not record them.
+    int pages;
+    int words;
+    int slides;
+
+    DocumentStats() : bytes(0), pages(-1), words(-1), slides(-1) {}
+};
+
+// Reads the file size and, for .docx/.xlsx/.pptx packages, the page, word
+// and slide counts that Office stores in docProps/app.xml.
+DocumentStats ReadDocumentStats(const std::string &path);
+
+// Rough conversion time in milliseconds, used to order queued jobs
+// shortest first. Only the relative order matters.
+double EstimateCost(const ConversionJob &job);
+
+#endif  // CONVERT_ESTIMATE_H_
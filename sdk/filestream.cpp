@@ -0,0 +1,29 @@
+#include "filestream.h"
+
+#include <string>
+
+using namespace std;
+
+FileStreamReader::FileStreamReader() : file_(NULL) {}
+
+FileStreamReader::~FileStreamReader()
+{
+    if (file_)
+        file_->Release();
+}
+
+bool FileStreamReader::Open(const string &path)
+{
+    file_ = FX_CreateFileStream(path.c_str(), FX_FILEMODE_ReadOnly);
+    return file_ != NULL;
+}
+
+FX_FILESIZE FileStreamReader::GetSize()
+{
+    return file_ ? file_->GetSize() : 0;
+}
+
+FX_BOOL FileStreamReader::ReadBlock(void *buffer, FX_FILESIZE offset, size_t size)
+{
+    return file_ && file_->ReadBlock(buffer, offset, size);
+}
@@ -0,0 +1,34 @@
+#ifndef CONVERT_FILESTREAM_H_
+#define CONVERT_FILESTREAM_H_
+
+#include <string>
+
+#include "common/fs_common.h"
+#include "common/file/fs_file.h"
+
+// Serves a file to the SDK through an IFX_FileStream, which reads each block
+// from disk at its offset as the SDK asks for it. Used in place of
+// MappedReader for very large PDFs, such as those carrying scanned
+// appendices, so that loading one does not pull the whole file into memory.
+// The reader must outlive any PDFDoc constructed from it.
+class FileStreamReader : public foxit::common::file::ReaderCallback
+{
+public:
+    FileStreamReader();
+    ~FileStreamReader();
+
+    // Opens `path` for reading. Returns false if the file cannot be opened.
+    bool Open(const std::string &path);
+
+    void Release() {}
+    FX_FILESIZE GetSize();
+    FX_BOOL ReadBlock(void *buffer, FX_FILESIZE offset, size_t size);
+
+private:
+    FileStreamReader(const FileStreamReader &);
+    FileStreamReader &operator=(const FileStreamReader &);
+
+    IFX_FileStream *file_;
+};
+
+#endif  // CONVERT_FILESTREAM_H_
@@ -0,0 +1,546 @@
+#include "job.h"
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pdf/fs_pdfdoc.h"
+
+#include "cache.h"
+#include "clone.h"
+#include "pdfa.h"
+#include "stream.h"
+#include "text.h"
+#include "thumbnails.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::addon::conversion;
+using namespace foxit::pdf;
+
+// Default location of the LibreOffice installation used by the SDK to render Office documents
+static const char *kDefaultEnginePath = "/opt/libreoffice6.4/program";
+
+static string g_engine_directory;
+static WString g_engine_path;
+static ResultCache *g_cache = NULL;
+
+static const string &EngineDirectory()
+{
+    if (g_engine_directory.empty())
+    {
+        const char *path = getenv("FOXIT_ENGINE_PATH");
+        g_engine_directory = path && *path ? path : kDefaultEnginePath;
+    }
+    return g_engine_directory;
+}
+
+static const WString &EnginePath()
+{
+    if (g_engine_path.IsEmpty())
+        g_engine_path = WString::FromUTF8(EngineDirectory().c_str());
+    return g_engine_path;
+}
+
+// Splits `text` on every occurrence of `separator`, keeping empty fields
+static vector<string> Split(const string &text, char separator)
+{
+    vector<string> fields;
+    string::size_type start = 0;
+    for (;;)
+    {
+        string::size_type end = text.find(separator, start);
+        if (end == string::npos)
+        {
+            fields.push_back(text.substr(start));
+            return fields;
+        }
+        fields.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+static const char *kFormatNames[kFormatCount] = {"word", "excel", "powerpoint", "image"};
+
+const char *FormatName(DocumentFormat format)
+{
+    return format < kFormatCount ? kFormatNames[format] : "unknown";
+}
+
+bool ParseFormatName(const string &name, DocumentFormat &format)
+{
+    for (int i = 0; i < kFormatCount; i++)
+    {
+        if (name == kFormatNames[i])
+        {
+            format = (DocumentFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+string OutputBase(const string &output)
+{
+    string::size_type slash = output.rfind('/');
+    string::size_type dot = output.rfind('.');
+    return dot != string::npos && (slash == string::npos || dot > slash) ? output.substr(0, dot) : output;
+}
+
+DocumentFormat FormatFromPath(const string &path)
+{
+    string::size_type dot = path.rfind('.');
+    if (dot == string::npos || path.find('/', dot) != string::npos)
+        return kFormatWord;
+
+    string extension = path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); i++)
+        extension[i] = tolower((unsigned char)extension[i]);
+
+    if (extension == "xls" || extension == "xlsx" || extension == "xlsm" || extension == "ods" || extension == "csv")
+        return kFormatExcel;
+    if (extension == "ppt" || extension == "pptx" || extension == "pptm" || extension == "odp")
+        return kFormatPowerPoint;
+    if (extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" ||
+        extension == "tif" || extension == "tiff" || extension == "gif")
+        return kFormatImage;
+    return kFormatWord;
+}
+
+// Parses a whole number from 1 to `max`
+static bool ParseCount(const string &text, int max, int &value)
+{
+    char *end = NULL;
+    long number = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end || number < 1 || number > max)
+        return false;
+    value = (int)number;
+    return true;
+}
+
+bool ParseSettings(const string &text, ConversionJob &job, string &error)
+{
+    Word2PDFSettingData &settings = job.settings;
+    if (text.empty())
+        return true;
+
+    vector<string> pairs = Split(text, ',');
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        if (pairs[i].empty())
+            continue;
+
+        string::size_type equals = pairs[i].find('=');
+        string name = pairs[i].substr(0, equals);
+        string value = equals == string::npos ? "" : pairs[i].substr(equals + 1);
+
+        if (name == "doc_props" && (value == "0" || value == "1"))
+            settings.include_doc_props = value == "1";
+        else if (name == "optimize" && value == "print")
+            settings.optimize_option = Word2PDFSettingData::e_ConvertOptimizeOptionForPrint;
+        else if (name == "optimize" && value == "screen")
+            settings.optimize_option = Word2PDFSettingData::e_ConvertOptimizeOptionForOnScreen;
+        else if (name == "content" && value == "only")
+            settings.content_option = Word2PDFSettingData::e_ConvertContentOptionOnlyContent;
+        else if (name == "content" && value == "markup")
+            settings.content_option = Word2PDFSettingData::e_ConvertContentOptionWithMarkup;
+        else if (name == "bookmarks" && value == "none")
+            settings.bookmark_option = Word2PDFSettingData::e_ConvertBookmarkOptionNone;
+        else if (name == "bookmarks" && value == "headings")
+            settings.bookmark_option = Word2PDFSettingData::e_ConvertBookmarkOptionUseHeadings;
+        else if (name == "bookmarks" && value == "word")
+            settings.bookmark_option = Word2PDFSettingData::e_ConvertBookmarkOptionUseWordBookmark;
+        else if (name == "save" && value == "converted")
+            job.save_mode = kSaveAsConverted;
+        else if (name == "save" && value == "linearized")
+            job.save_mode = kSaveLinearized;
+        else if (name == "save" && value == "compact")
+            job.save_mode = kSaveCompact;
+        else if (name == "pdfa" && value == "none")
+            job.pdfa = kPdfaNone;
+        else if (name == "pdfa" && value == "1b")
+            job.pdfa = kPdfa1b;
+        else if (name == "pdfa" && value == "2b")
+            job.pdfa = kPdfa2b;
+        else if (name == "pdfa" && value == "2u")
+            job.pdfa = kPdfa2u;
+        else if (name == "pdfa" && value == "3b")
+            job.pdfa = kPdfa3b;
+        else if (name == "thumbnails" && ParseCount(value, 1000, job.thumbnails.pages))
+            ;
+        else if (name == "thumbnail_size" && ParseCount(value, 4096, job.thumbnails.size))
+            ;
+        else if (name == "thumbnail_mode" && (value == "full" || value == "draft"))
+            job.thumbnails.draft = value == "draft";
+        else if (name == "thumbnail_format" && value == "png")
+            job.thumbnails.format = kThumbnailPng;
+        else if (name == "thumbnail_format" && value == "jpg")
+            job.thumbnails.format = kThumbnailJpeg;
+        else if (name == "text" && (value == "none" || value == "json"))
+            job.extract_text = value == "json";
+        else if (name == "subset_fonts" && (value == "0" || value == "1"))
+            job.subset_fonts = value == "1";
+        else if (name == "image_dpi" && ParseCount(value, 2400, job.images.dpi))
+            ;
+        else if (name == "image_quality" && ParseCount(value, 5, job.images.quality))
+            ;
+        else if (name == "mono_dpi" && ParseCount(value, 2400, job.images.mono_dpi))
+            ;
+        else if (name == "timeout_ms" && ParseCount(value, 86400000, job.timeout_ms))
+            ;
+        else if (name == "image_budget_ms" && ParseCount(value, 3600000, job.images.budget_ms))
+            ;
+        else
+        {
+            error = "unknown setting '" + pairs[i] + "'";
+            return false;
+        }
+    }
+    // The compliance engine writes the PDF/A file itself, last, so a
+    // linearized or compacted save would be thrown away
+    if (job.pdfa != kPdfaNone && (job.save_mode == kSaveLinearized || job.save_mode == kSaveCompact))
+    {
+        error = "pdfa cannot be combined with save=linearized or save=compact";
+        return false;
+    }
+    return true;
+}
+
+string SettingsKey(const ConversionJob &job)
+{
+    ostringstream key;
+    key << FormatName(job.format) << " doc_props=" << job.settings.include_doc_props
+        << " optimize=" << job.settings.optimize_option << " content=" << job.settings.content_option
+        << " bookmarks=" << job.settings.bookmark_option << " save=" << job.save_mode;
+    if (job.subset_fonts)
+        key << " subset_fonts=1";
+    if (job.pdfa != kPdfaNone)
+        key << " pdfa=" << job.pdfa;
+    if (job.images.dpi > 0)
+        key << " image_dpi=" << job.images.dpi << " image_quality=" << job.images.quality
+            << " mono_dpi=" << job.images.mono_dpi << " image_budget_ms=" << job.images.budget_ms;
+    return key.str();
+}
+
+bool ParseJobLine(const string &line, ConversionJob &job, string &error)
+{
+    vector<string> fields = Split(line, '\t');
+    if (fields.size() < 2 || fields.size() > 4 || fields[0].empty() || fields[1].empty())
+    {
+        error = "expected <input>\\t<output>[\\t<password>[\\t<settings>]]";
+        return false;
+    }
+
+    job.input = fields[0];
+    job.output = fields[1];
+    job.password = fields.size() > 2 ? fields[2] : "";
+    job.format = FormatFromPath(job.input);
+    job.settings = Word2PDFSettingData();
+    job.save_mode = kSaveAsConverted;
+    job.subset_fonts = false;
+    job.images = ImageOptions();
+    job.pdfa = kPdfaNone;
+    job.thumbnails = ThumbnailOptions();
+    job.extract_text = false;
+    job.timeout_ms = 0;
+    return ParseSettings(fields.size() > 3 ? fields[3] : "", job, error);
+}
+
+void SetEnginePath(const string &path)
+{
+    g_engine_directory = path;
+    g_engine_path = WString::FromUTF8(path.c_str());
+}
+
+string ConverterVersion()
+{
+    string version = (const char *)Library::GetVersion();
+    ifstream versionrc((EngineDirectory() + "/versionrc").c_str());
+    string line;
+    while (getline(versionrc, line))
+        version += "\n" + line;
+    return version;
+}
+
+void SetResultCache(ResultCache *cache)
+{
+    g_cache = cache;
+}
+
+ConversionResult WarmUpEngine(const string &sample)
+{
+    char directory[] = "/tmp/convert-warmup-XXXXXX";
+    ConversionResult result;
+    if (!mkdtemp(directory))
+    {
+        result.code = e_ErrFile;
+        result.message = "cannot create warm-up directory";
+        return result;
+    }
+
+    ConversionJob job;
+    job.input = sample;
+    job.output = string(directory) + "/warmup.pdf";
+    job.cacheable = false;
+    result = RunJob(job);
+
+    unlink(job.output.c_str());
+    rmdir(directory);
+    return result;
+}
+
+// Runs the engine for the job's format, writing the PDF to `output`. SDK
+// failures are thrown.
+static void ConvertDocument(const ConversionJob &job, const string &output)
+{
+    // Paths arrive as UTF-8 from the shell, the daemon protocol and manifests
+    WString input = WString::FromUTF8(job.input.c_str());
+    WString pdf = WString::FromUTF8(output.c_str());
+    WString password = WString::FromUTF8(job.password.c_str());
+
+    switch (job.format)
+    {
+    case kFormatExcel:
+    {
+        Excel2PDFSettingData excel_settings;
+        excel_settings.include_doc_props = job.settings.include_doc_props;
+        Convert::FromExcel(input, password, pdf, EnginePath(), excel_settings);
+        break;
+    }
+    case kFormatPowerPoint:
+    {
+        PowerPoint2PDFSettingData powerpoint_settings;
+        powerpoint_settings.include_doc_props = job.settings.include_doc_props;
+        Convert::FromPowerPoint(input, password, pdf, EnginePath(), powerpoint_settings);
+        break;
+    }
+    case kFormatImage:
+        Convert::FromImage(input, pdf);
+        break;
+    default:
+        Convert::FromWord(input, password, pdf, EnginePath(), job.settings);
+        break;
+    }
+}
+
+// Copies a cached PDF to the job's output file, or streams it into the
+// output pipe or socket
+static void DeliverCachedPdf(int cached, const string &output, ConversionResult &result)
+{
+    if (IsStreamTarget(output))
+    {
+        SendToStream(cached, output, result);
+        return;
+    }
+
+    int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0 && CloneData(cached, out);
+    if (out >= 0 && close(out) < 0)
+        ok = false;
+    if (!ok)
+    {
+        result.code = e_ErrFile;
+        result.message = "cannot copy cached PDF to the output";
+    }
+}
+
+// Whether the engine's PDF is loaded again to be modified or re-saved,
+// rather than kept as it is
+static bool ProcessesPdf(const ConversionJob &job)
+{
+    return job.save_mode != kSaveAsConverted || job.subset_fonts || job.images.dpi > 0;
+}
+
+// Whether the job asks for files besides the PDF, read back from the
+// finished PDF
+static bool HasSideOutputs(const ConversionJob &job)
+{
+    return job.thumbnails.pages > 0 || job.extract_text;
+}
+
+// Writes the job's side outputs from the finished PDF open at `fd`. Their
+// failures are reported as stats and do not fail the job.
+static void WriteSideOutputs(int fd, const ConversionJob &job, ConversionResult &result)
+{
+    if (job.thumbnails.pages > 0)
+        RenderThumbnails(fd, job.output, job.thumbnails, result);
+    if (job.extract_text)
+        ExtractText(fd, job.output, result);
+}
+
+// Sends the finished PDF at `pdf` into the FIFO or socket at `target`
+static void SendPdf(const string &pdf, const string &target, ConversionResult &result)
+{
+    int fd = open(pdf.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        result.code = e_ErrFile;
+        result.message = string("cannot open finished PDF: ") + strerror(errno);
+        return;
+    }
+    SendToStream(fd, target, result);
+    close(fd);
+}
+
+ConversionResult RunJob(const ConversionJob &job)
+{
+    ConversionResult result;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // A PDF already converted from the same bytes with the same settings is
+    // handed back as is, without starting the engine
+    string cache_key;
+    int cache_lock = -1;
+    if (g_cache && job.cacheable && g_cache->Key(job, cache_key))
+    {
+        int cached = g_cache->Open(cache_key);
+        if (cached < 0)
+        {
+            // If an identical job is converting elsewhere, wait for it and
+            // take its PDF rather than start the engine a second time
+            chrono::steady_clock::time_point wait_start = chrono::steady_clock::now();
+            cache_lock = g_cache->Lock(cache_key);
+            cached = g_cache->Open(cache_key);
+            if (cached >= 0)
+            {
+                AddStat(result, "coalesced_ms",
+                        chrono::duration<double, milli>(chrono::steady_clock::now() - wait_start).count());
+                if (cache_lock >= 0)
+                    g_cache->Unlock(cache_key, cache_lock);
+            }
+        }
+        if (cached >= 0)
+        {
+            DeliverCachedPdf(cached, job.output, result);
+            if (result.code == e_ErrSuccess)
+                WriteSideOutputs(cached, job, result);
+            close(cached);
+            if (result.code == e_ErrSuccess)
+                AddStat(result, "cache_hit", 1);
+            result.elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            return result;
+        }
+    }
+
+    // The engines only write to files, so a PDF that is re-saved, or bound
+    // for a pipe or socket, is first converted into a scratch file beside it.
+    // A streamed PDF that needs no processing is sent from there as it is.
+    // PDF/A conversion comes last, so that the file delivered is the one the
+    // compliance engine checked. It also goes from file to file: a re-saved
+    // PDF is saved to a second file for it, and a streamed one is converted
+    // into a third and sent from there. When a PDF re-saved into a stream
+    // is needed again, for the cache or side outputs, the saved bytes are
+    // copied to a file as they are written.
+    bool streamed = IsStreamTarget(job.output);
+    bool saved = ProcessesPdf(job);
+    bool archival = job.pdfa != kPdfaNone;
+    string scratch;
+    string resaved;
+    string archived;
+    string copy;
+    if ((saved || archival || streamed) && !CreateScratchPdf(job.output, scratch))
+    {
+        result.code = e_ErrFile;
+        result.message = "cannot create scratch file for the converted PDF";
+    }
+    else if (!scratch.empty())
+    {
+        string base = scratch.substr(0, scratch.size() - 4);
+        if (archival && saved)
+            resaved = base + "-saved.pdf";
+        if (archival && streamed)
+            archived = base + "-pdfa.pdf";
+        if (saved && !archival && streamed && (!cache_key.empty() || HasSideOutputs(job)))
+            copy = base + "-copy.pdf";
+    }
+
+    if (result.code == e_ErrSuccess)
+    {
+        try
+        {
+            chrono::steady_clock::time_point engine_start = chrono::steady_clock::now();
+            ConvertDocument(job, scratch.empty() ? job.output : scratch);
+            if (!scratch.empty())
+                AddStat(result, "engine_ms",
+                        chrono::duration<double, milli>(chrono::steady_clock::now() - engine_start).count());
+            if (saved)
+                SavePdf(scratch, archival ? resaved : job.output, job, copy, result);
+            if (archival && result.code == e_ErrSuccess)
+                ConvertToPdfa(saved ? resaved : scratch, streamed ? archived : job.output, job.pdfa, result);
+            if (streamed && !(saved && !archival) && result.code == e_ErrSuccess)
+                SendPdf(archival ? archived : scratch, job.output, result);
+        }
+        catch (const foxit::Exception &e)
+        {
+            result.code = e.GetErrCode();
+            result.message = (const char *)e.GetMessage();
+        }
+        catch (const std::exception &e)
+        {
+            result.code = kErrInternal;
+            result.message = e.what();
+        }
+    }
+
+    // A streamed PDF is read back from the last file it went through
+    string delivered = !streamed ? job.output : archival ? archived : saved ? copy : scratch;
+    if (result.code == e_ErrSuccess && HasSideOutputs(job))
+    {
+        int fd = open(delivered.c_str(), O_RDONLY | O_CLOEXEC);
+        WriteSideOutputs(fd, job, result);
+        if (fd >= 0)
+            close(fd);
+    }
+    if (!cache_key.empty() && result.code == e_ErrSuccess && result.publishable)
+        g_cache->Publish(cache_key, delivered);
+    if (cache_lock >= 0)
+        g_cache->Unlock(cache_key, cache_lock);
+    if (!scratch.empty())
+        unlink(scratch.c_str());
+    if (!resaved.empty())
+        unlink(resaved.c_str());
+    if (!archived.empty())
+        unlink(archived.c_str());
+    if (!copy.empty())
+        unlink(copy.c_str());
+    result.elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void AddStat(ConversionResult &result, const char *name, double value)
+{
+    char stat[128];
+    snprintf(stat, sizeof(stat), " %s=%.1f", name, value);
+    result.stats += stat;
+}
+
+string FormatResult(const ConversionResult &result)
+{
+    char elapsed[32];
+    snprintf(elapsed, sizeof(elapsed), "%.1f", result.elapsed_ms);
+
+    if (result.code == e_ErrSuccess)
+        return string("OK ") + elapsed + result.stats;
+
+    // Keep the reply on one line whatever the SDK put in its message
+    string message = result.message.empty() ? "conversion failed" : result.message;
+    for (size_t i = 0; i < message.size(); i++)
+    {
+        if (message[i] == '\n' || message[i] == '\r' || message[i] == '\t')
+            message[i] = ' ';
+    }
+
+    ostringstream line;
+    line << "ERR " << result.code << " " << message;
+    return line.str();
+}
@@ -0,0 +1,206 @@
+#ifndef CONVERT_JOB_H_
+#define CONVERT_JOB_H_
+
+#include <string>
+
+#include "common/fs_common.h"
+#include "addon/conversion/fs_convert.h"
+
+// Source document formats the converter handles, each through its own
+// Convert::From* engine.
+enum DocumentFormat
+{
+    kFormatWord,
+    kFormatExcel,
+    kFormatPowerPoint,
+    kFormatImage,
+    kFormatCount
+};
+
+// How the PDF the engine wrote is turned into the job's output.
+enum SaveMode
+{
+    // Keep the engine's file as it is
+    kSaveAsConverted,
+    // Re-save it linearized ("fast web view"), so that a viewer fetching byte
+    // ranges can show the first page before the rest has downloaded
+    kSaveLinearized,
+    // Re-save it with objects packed into cross-reference and object streams
+    // and duplicate objects removed, leaving images untouched
+    kSaveCompact
+};
+
+// PDF/A conformance level the output is converted to, if any.
+enum PdfaLevel
+{
+    kPdfaNone,
+    kPdfa1b,
+    kPdfa2b,
+    kPdfa2u,
+    kPdfa3b
+};
+
+// Image downsampling and recompression applied to the converted PDF before
+// it is saved. Off unless `dpi` is set.
+struct ImageOptions
+{
+    // Color and grayscale images above this resolution are downsampled to it
+    // and stored as JPEG; 0 leaves images alone
+    int dpi;
+    // JPEG quality, from 1 (minimum) to 5 (maximum)
+    int quality;
+    // Resolution monochrome images are downsampled to
+    int mono_dpi;
+    // Time allowed for the images. Once it is spent the PDF is saved with its
+    // original images instead.
+    int budget_ms;
+
+    ImageOptions() : dpi(0), quality(3), mono_dpi(300), budget_ms(5000) {}
+};
+
+// Image format of page thumbnails.
+enum ThumbnailFormat
+{
+    kThumbnailPng,
+    kThumbnailJpeg
+};
+
+// Page thumbnails written next to the output. Off unless `pages` is set.
+struct ThumbnailOptions
+{
+    // How many pages, from the first, get a thumbnail
+    int pages;
+    // Length of the longer side, in pixels
+    int size;
+    // Whether to use the SDK's quick render, which skips annotations and
+    // draws text as blurred dots, instead of a full render
+    bool draft;
+    ThumbnailFormat format;
+
+    ThumbnailOptions() : pages(0), size(256), draft(false), format(kThumbnailPng) {}
+};
+
+// A single document to PDF conversion, as described on the command line, in
+// a daemon request line or in a batch manifest row.
+struct ConversionJob
+{
+    std::string input;
+    std::string output;
+    std::string password;
+    DocumentFormat format;
+    // Word conversion settings. Excel and PowerPoint conversions only take
+    // include_doc_props from here.
+    foxit::addon::conversion::Word2PDFSettingData settings;
+    SaveMode save_mode;
+    // Whether embedded fonts are cut down to the glyphs the document uses
+    bool subset_fonts;
+    ImageOptions images;
+    PdfaLevel pdfa;
+    // Thumbnails are a side output and do not change the PDF
+    ThumbnailOptions thumbnails;
+    // Whether to write the text of each page to a JSON sidecar. Like
+    // thumbnails it does not change the PDF.
+    bool extract_text;
+    // Forked jobs still running after this many milliseconds are killed,
+    // together with the engine processes they started. 0 means no limit.
+    // Jobs run in-process cannot be stopped and ignore it.
+    int timeout_ms;
+    // Whether RunJob may answer from, and publish to, the result cache (see
+    // SetResultCache). Warm-ups clear it so they really start the engine.
+    bool cacheable;
+
+    ConversionJob() : format(kFormatWord), save_mode(kSaveAsConverted), subset_fonts(false), pdfa(kPdfaNone), extract_text(false), timeout_ms(0), cacheable(true) {}
+};
+
+// Returns the lower-case name of a format ("word", "excel", ...).
+const char *FormatName(DocumentFormat format);
+
+// Looks a format up by the name FormatName returns.
+bool ParseFormatName(const std::string &name, DocumentFormat &format);
+
+// Picks the format from the file extension of `path`, defaulting to Word.
+DocumentFormat FormatFromPath(const std::string &path);
+
+// The output path without its extension, to which side outputs such as
+// thumbnails and the text sidecar add a suffix.
+std::string OutputBase(const std::string &output);
+
+// Failures of the converter's own stages rather than of the SDK. They are
+// numbered above the SDK's ErrorCode values so that the two never collide.
+enum ConverterError
+{
+    // A C++ exception from outside the SDK, such as std::bad_alloc
+    kErrInternal = 1000,
+    // A forked worker crashed or exited without reporting a result
+    kErrWorkerDied = 1001,
+    // The compliance engine could not make the document PDF/A compliant
+    kErrNotCompliant = 1002,
+    // Subsetting the embedded fonts failed
+    kErrSubsetFailed = 1003,
+    // A forked job ran past its timeout_ms and was killed
+    kErrTimedOut = 1004
+};
+
+// The outcome of running a ConversionJob. `code` holds the Foxit error code
+// or a ConverterError (e_ErrSuccess when the conversion worked) and `message`
+// a short description of the failure. `stats` collects extra "name=value" measurements that are
+// appended to the OK status line.
+struct ConversionResult
+{
+    int code;
+    std::string message;
+    double elapsed_ms;
+    std::string stats;
+    // Whether the PDF may go into the result cache. Cleared when a stage
+    // gave up on something the settings asked for, such as an image
+    // optimization that ran out of time, so that a later identical job
+    // gets another try rather than the degraded PDF.
+    bool publishable;
+
+    ConversionResult() : code(foxit::e_ErrSuccess), elapsed_ms(0), publishable(true) {}
+};
+
+// Parses a comma separated list of settings such as
+// "doc_props=1,optimize=screen,content=markup,bookmarks=headings,save=linearized,image_dpi=150"
+// into the job's settings, save mode and post-processing options. Returns false and
+// fills `error` on an unknown setting.
+bool ParseSettings(const std::string &text, ConversionJob &job, std::string &error);
+
+// Describes every job field other than the input and password that changes
+// the PDF produced, for use in result cache keys.
+std::string SettingsKey(const ConversionJob &job);
+
+// Parses a tab separated request line of the form
+// "<input>\t<output>[\t<password>[\t<settings>]]".
+bool ParseJobLine(const std::string &line, ConversionJob &job, std::string &error);
+
+// Overrides the LibreOffice program directory handed to Convert::FromWord.
+// Defaults to $FOXIT_ENGINE_PATH, or /opt/libreoffice6.4/program when unset.
+void SetEnginePath(const std::string &path);
+
+// Identifies the SDK and engine builds (the SDK version and the engine's
+// versionrc), so that cached results are not reused across upgrades.
+std::string ConverterVersion();
+
+class ResultCache;
+
+// Makes RunJob answer repeated jobs from `cache` and publish the PDFs it
+// converts there. Pass NULL, the default, to convert every job.
+void SetResultCache(ResultCache *cache);
+
+// Converts `sample` into a throwaway PDF so that the engine binaries are paged
+// in and its user profile exists before real requests arrive.
+ConversionResult WarmUpEngine(const std::string &sample);
+
+// Converts the job's document to PDF. The library must already be
+// initialized; SDK exceptions are caught and reported through the result.
+ConversionResult RunJob(const ConversionJob &job);
+
+// Appends a "name=value" measurement to the result's stats.
+void AddStat(ConversionResult &result, const char *name, double value);
+
+// Formats a result as a single status line, "OK <ms>[ <name>=<value>...]" or
+// "ERR <code> <message>", without the trailing newline.
+std::string FormatResult(const ConversionResult &result);
+
+#endif  // CONVERT_JOB_H_
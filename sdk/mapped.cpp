@@ -0,0 +1,89 @@
+#include "mapped.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::pdf;
+
+MappedReader::MappedReader() : data_(NULL), size_(0) {}
+
+MappedReader::~MappedReader()
+{
+    if (data_)
+        munmap((void *)data_, size_);
+}
+
+bool MappedReader::Open(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    // The mapping keeps its own reference to the file
+    bool mapped = Open(fd);
+    int error = errno;
+    close(fd);
+    errno = error;
+    return mapped;
+}
+
+bool MappedReader::Open(int fd)
+{
+    struct stat info;
+    if (fstat(fd, &info) < 0)
+        return false;
+    if (info.st_size == 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    // The SDK reads the trailer first and then jumps between objects, so
+    // read the whole file ahead rather than rely on sequential readahead
+    madvise(data, info.st_size, MADV_WILLNEED);
+    madvise(data, info.st_size, MADV_RANDOM);
+
+    data_ = (const char *)data;
+    size_ = info.st_size;
+    return true;
+}
+
+FX_FILESIZE MappedReader::GetSize()
+{
+    return size_;
+}
+
+FX_BOOL MappedReader::ReadBlock(void *buffer, FX_FILESIZE offset, size_t size)
+{
+    if (offset < 0 || (size_t)offset > size_ || size > size_ - offset)
+        return false;
+    memcpy(buffer, data_ + offset, size);
+    return true;
+}
+
+ErrorCode LoadMappedPdf(PDFDoc &doc, const string &password)
+{
+    Progressive::State state = FinishProgressive(doc.StartLoad(password.c_str(), false));
+    return state == Progressive::e_Finished ? e_ErrSuccess : e_ErrFormat;
+}
+
+Progressive::State FinishProgressive(Progressive progress)
+{
+    Progressive::State state = progress.GetRateOfProgress() == 100 ? Progressive::e_Finished : Progressive::e_ToBeContinued;
+    while (state == Progressive::e_ToBeContinued)
+        state = progress.Continue();
+    return state;
+}
@@ -0,0 +1,47 @@
+#ifndef CONVERT_MAPPED_H_
+#define CONVERT_MAPPED_H_
+
+#include <string>
+
+#include "common/fs_common.h"
+#include "common/file/fs_file.h"
+#include "pdf/fs_pdfdoc.h"
+
+// Serves a file to the SDK from a read-only memory mapping, so every stage
+// that reopens a converted PDF shares the page cache instead of copying the
+// file through read() into buffers of its own. The reader must outlive any
+// PDFDoc constructed from it.
+class MappedReader : public foxit::common::file::ReaderCallback
+{
+public:
+    MappedReader();
+    ~MappedReader();
+
+    // Maps `path` and asks the kernel to start reading it in. Returns false
+    // and leaves errno set if the file cannot be opened or mapped.
+    bool Open(const std::string &path);
+    // Maps the file open at `fd`, which stays owned by the caller.
+    bool Open(int fd);
+
+    void Release() {}
+    FX_FILESIZE GetSize();
+    FX_BOOL ReadBlock(void *buffer, FX_FILESIZE offset, size_t size);
+
+private:
+    MappedReader(const MappedReader &);
+    MappedReader &operator=(const MappedReader &);
+
+    const char *data_;
+    size_t size_;
+};
+
+// Loads a document constructed from a MappedReader or FileStreamReader. Stream
+// content is left in the file and read on demand rather than cached in SDK
+// memory.
+foxit::ErrorCode LoadMappedPdf(foxit::pdf::PDFDoc &doc, const std::string &password = std::string());
+
+// Continues `progress` until it is no longer to be continued and returns its
+// final state, e_Finished on success.
+foxit::common::Progressive::State FinishProgressive(foxit::common::Progressive progress);
+
+#endif  // CONVERT_MAPPED_H_
@@ -0,0 +1,123 @@
+#include "optimize.h"
+
+#include <chrono>
+#include <set>
+
+#include "addon/optimization/fs_optimization.h"
+#include "pdf/fs_pdfpage.h"
+
+#include "mapped.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::pdf;
+using namespace foxit::pdf::objects;
+using namespace foxit::addon::optimization;
+
+// Pauses the optimizer once the deadline has passed, so that the caller
+// regains control and can abandon it
+class DeadlinePause : public PauseCallback
+{
+public:
+    explicit DeadlinePause(chrono::steady_clock::time_point deadline) : deadline_(deadline) {}
+
+    FX_BOOL NeedToPauseNow() { return Expired(); }
+    bool Expired() const { return chrono::steady_clock::now() >= deadline_; }
+
+private:
+    chrono::steady_clock::time_point deadline_;
+};
+
+bool OptimizeImages(const PDFDoc &doc, const ImageOptions &options)
+{
+    ImageSettings images;
+    images.SetImageDPI(options.dpi);
+    images.SetCompressionMode(ImageSettings::e_ImageCompressjpeg);
+    images.SetQuality((ImageSettings::ImageCompressQuality)options.quality);
+
+    MonoImageSettings mono_images;
+    mono_images.SetImageDPI(options.mono_dpi);
+
+    // Only the images are touched; clean-up and discarding would change
+    // more of the document than the job asked for
+    OptimizerSettings settings;
+    settings.SetOptimizerOptions(OptimizerSettings::e_OptimizerCompressImages);
+    settings.SetColorGrayImageSettings(images);
+    settings.SetMonoImageSettings(mono_images);
+
+    DeadlinePause pause(chrono::steady_clock::now() + chrono::milliseconds(options.budget_ms));
+    // Not FinishProgressive: the pause hands control back at the deadline,
+    // and the optimization is abandoned rather than continued
+    Progressive progress = Optimizer::Optimize(doc, settings, &pause);
+    Progressive::State state = progress.GetRateOfProgress() == 100 ? Progressive::e_Finished : Progressive::e_ToBeContinued;
+    while (state == Progressive::e_ToBeContinued && !pause.Expired())
+        state = progress.Continue();
+    return state == Progressive::e_Finished;
+}
+
+bool SubsetFonts(const PDFDoc &doc)
+{
+    return FinishProgressive(Optimizer::StartSubsetEmbedFont(doc, NULL)) == Progressive::e_Finished;
+}
+
+// Returns the dictionary under `key` in `dictionary`, following references
+static PDFDictionary *ElementDict(PDFDictionary *dictionary, const char *key)
+{
+    PDFObject *element = dictionary ? dictionary->GetElement(key) : NULL;
+    return element ? element->GetDict() : NULL;
+}
+
+// Adds the size of the program embedded through `font`'s descriptor, unless
+// it has been counted already
+static void AddFontProgram(PDFDictionary *font, set<uint32> &counted, uint64 &bytes)
+{
+    PDFDictionary *descriptor = ElementDict(font, "FontDescriptor");
+    if (!descriptor)
+        return;
+
+    static const char *kProgramKeys[] = {"FontFile", "FontFile2", "FontFile3"};
+    for (size_t i = 0; i < sizeof(kProgramKeys) / sizeof(kProgramKeys[0]); i++)
+    {
+        PDFObject *element = descriptor->GetElement(kProgramKeys[i]);
+        PDFStream *program = element ? element->GetStream() : NULL;
+        if (program && counted.insert(program->GetObjNum()).second)
+            bytes += program->GetDataSize(true);
+    }
+}
+
+uint64 EmbeddedFontBytes(PDFDoc &doc)
+{
+    set<uint32> counted;
+    uint64 bytes = 0;
+    for (int i = 0; i < doc.GetPageCount(); i++)
+    {
+        // Resources may be inherited from an ancestor in the page tree
+        PDFPage page = doc.GetPage(i);
+        PDFObject *resources = page.GetInheritedAttribute("Resources");
+        PDFDictionary *fonts = ElementDict(resources ? resources->GetDict() : NULL, "Font");
+        if (!fonts)
+            continue;
+
+        for (POSITION position = fonts->MoveNext(NULL); position;)
+        {
+            PDFObject *element = fonts->GetValue(position);
+            position = fonts->MoveNext(position);
+            PDFDictionary *font = element ? element->GetDict() : NULL;
+            if (!font)
+                continue;
+
+            // Composite fonts keep their program with their one descendant font
+            PDFObject *descendants = font->GetElement("DescendantFonts");
+            PDFArray *array = descendants ? descendants->GetArray() : NULL;
+            if (array && array->GetElementCount() > 0)
+            {
+                PDFObject *descendant = array->GetElement(0);
+                font = descendant ? descendant->GetDict() : NULL;
+            }
+            if (font)
+                AddFontProgram(font, counted, bytes);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,24 @@
+#ifndef CONVERT_OPTIMIZE_H_
+#define CONVERT_OPTIMIZE_H_
+
+#include "pdf/fs_pdfdoc.h"
+
+#include "job.h"
+
+// Downsamples and recompresses the images in `doc` as `options` describe,
+// through Optimizer::Optimize. Returns false if that fails or takes longer
+// than options.budget_ms; `doc` is then left part way through and has to be
+// reloaded to get the original images back. Missing module rights and other
+// SDK exceptions are thrown.
+bool OptimizeImages(const foxit::pdf::PDFDoc &doc, const ImageOptions &options);
+
+// Cuts the fonts embedded in `doc` down to the glyphs it uses, through
+// Optimizer::StartSubsetEmbedFont. Returns false if that fails; missing
+// module rights and other SDK exceptions are thrown.
+bool SubsetFonts(const foxit::pdf::PDFDoc &doc);
+
+// Sums the raw size of the font programs embedded for the fonts that the
+// pages of `doc` use, counting each program once.
+foxit::uint64 EmbeddedFontBytes(foxit::pdf::PDFDoc &doc);
+
+#endif  // CONVERT_OPTIMIZE_H_
@@ -0,0 +1,100 @@
+#include "pdfa.h"
+
+#include <chrono>
+#include <string>
+
+#include <unistd.h>
+
+#include "addon/compliance/fs_pdfa.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::addon::compliance;
+
+static bool g_pdfa_ready = false;
+
+ErrorCode InitializePdfa(const string &resource_folder, const string &unlock_code)
+{
+    WString folder = WString::FromUTF8(resource_folder.c_str());
+    ErrorCode code = ComplianceEngine::Initialize(folder, unlock_code.c_str());
+    g_pdfa_ready = code == e_ErrSuccess;
+    return code;
+}
+
+void ReleasePdfa()
+{
+    if (g_pdfa_ready)
+        ComplianceEngine::Release();
+    g_pdfa_ready = false;
+}
+
+// The compliance engine's name for a level
+static PDFACompliance::Version PdfaVersion(PdfaLevel level)
+{
+    switch (level)
+    {
+    case kPdfa1b:
+        return PDFACompliance::e_VersionPDFA1b;
+    case kPdfa2u:
+        return PDFACompliance::e_VersionPDFA2u;
+    case kPdfa3b:
+        return PDFACompliance::e_VersionPDFA3b;
+    default:
+        return PDFACompliance::e_VersionPDFA2b;
+    }
+}
+
+void ConvertToPdfa(const string &input, const string &output, PdfaLevel level, ConversionResult &result)
+{
+    if (!g_pdfa_ready)
+    {
+        result.code = e_ErrParam;
+        result.message = "PDF/A output needs the compliance engine (--compliance)";
+        return;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    WString source = WString::FromUTF8(input.c_str());
+    WString target = WString::FromUTF8(output.c_str());
+    PDFACompliance compliance;
+    ResultInformation information = compliance.ConvertPDFFile(source, target, PdfaVersion(level));
+    AddStat(result, "pdfa_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+    // Fixups are the changes the engine made; hits are problems it found
+    // and could not fix
+    int fixed = 0;
+    bool compliant = true;
+    string failure;
+    for (int i = 0; i < information.GetFixupDataCount(); i++)
+    {
+        FixupData fixup = information.GetFixupData(i);
+        if (fixup.state == FixupData::e_FixupStateSuccess)
+            fixed++;
+        else if (fixup.state == FixupData::e_FixupStateFailure && compliant)
+        {
+            compliant = false;
+            failure = (const char *)fixup.name.UTF8Encode();
+        }
+    }
+    for (int i = 0; i < information.GetHitDataCount() && compliant; i++)
+    {
+        HitData hit = information.GetHitData(i);
+        if (hit.severity == HitData::e_CheckSeverityError)
+        {
+            compliant = false;
+            failure = (const char *)hit.name.UTF8Encode();
+        }
+    }
+    AddStat(result, "pdfa_fixups", fixed);
+
+    // A file that claims to be PDF/A but is not must not reach an archive
+    if (!compliant)
+    {
+        unlink(output.c_str());
+        result.code = kErrNotCompliant;
+        result.message = "document cannot be made PDF/A compliant";
+        if (!failure.empty())
+            result.message += ": " + failure;
+    }
+}
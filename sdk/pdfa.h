@@ -0,0 +1,23 @@
+#ifndef CONVERT_PDFA_H_
+#define CONVERT_PDFA_H_
+
+#include <string>
+
+#include "job.h"
+
+// Sets up the compliance engine from its resource folder. Must be called
+// once, after Library::Initialize and before any job asks for PDF/A output.
+// Returns the SDK error code.
+foxit::ErrorCode InitializePdfa(const std::string &resource_folder, const std::string &unlock_code);
+
+// Releases the compliance engine, if it was set up. Call before Library::Release.
+void ReleasePdfa();
+
+// Converts the PDF at `input` into a PDF/A file of the given level at
+// `output`. Reports the time taken and the fixups applied. Fails the result
+// if the engine is not set up, or if the document could not be made
+// compliant, in which case `output` is removed. SDK failures are thrown.
+void ConvertToPdfa(const std::string &input, const std::string &output, PdfaLevel level,
+                   ConversionResult &result);
+
+#endif  // CONVERT_PDFA_H_
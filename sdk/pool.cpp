@@ -0,0 +1,179 @@
+#include "pool.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+bool ParseThreadCounts(const string &spec, ThreadCounts &counts)
+{
+    counts.assign(kFormatCount + 1, 0);
+
+    // A plain number starts that many shared threads
+    char *end = NULL;
+    long shared = strtol(spec.c_str(), &end, 10);
+    if (!spec.empty() && *end == '\0')
+    {
+        counts[kFormatCount] = (int)shared;
+        return shared > 0;
+    }
+
+    string::size_type start = 0;
+    while (start <= spec.size())
+    {
+        string::size_type comma = spec.find(',', start);
+        string pair = spec.substr(start, comma == string::npos ? string::npos : comma - start);
+        string::size_type equals = pair.find('=');
+        DocumentFormat format;
+        if (equals == string::npos || !ParseFormatName(pair.substr(0, equals), format))
+            return false;
+        int count = atoi(pair.substr(equals + 1).c_str());
+        if (count < 0)
+            return false;
+        counts[format] = count;
+
+        if (comma == string::npos)
+            break;
+        start = comma + 1;
+    }
+    return TotalThreads(counts) > 0;
+}
+
+int TotalThreads(const ThreadCounts &counts)
+{
+    int total = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+        total += counts[i];
+    return total;
+}
+
+WorkerPool::WorkerPool(const ThreadCounts &counts, size_t capacity, const CompletionHandler &on_complete)
+    : on_complete_(on_complete), capacity_(capacity), queued_(0), queues_(kFormatCount), closed_(false),
+      start_(chrono::steady_clock::now()), wall_ms_(0)
+{
+    for (size_t home = 0; home < counts.size(); home++)
+    {
+        for (int i = 0; i < counts[home]; i++)
+        {
+            stats_.push_back(ThreadStats());
+            stats_.back().home = (int)home;
+        }
+    }
+    for (size_t i = 0; i < stats_.size(); i++)
+        threads_.push_back(thread(&WorkerPool::Work, this, i));
+}
+
+WorkerPool::~WorkerPool()
+{
+    Join();
+}
+
+void WorkerPool::Submit(const QueuedJob &job)
+{
+    unique_lock<mutex> lock(mutex_);
+    while (queued_ >= capacity_)
+        not_full_.wait(lock);
+    queues_[job.job.format].Push(job);
+    queued_++;
+    not_empty_.notify_all();
+}
+
+void WorkerPool::Join()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (closed_)
+            return;
+        closed_ = true;
+    }
+    not_empty_.notify_all();
+
+    for (size_t i = 0; i < threads_.size(); i++)
+        threads_[i].join();
+    wall_ms_ = chrono::duration<double, milli>(chrono::steady_clock::now() - start_).count();
+}
+
+void WorkerPool::PrintUtilization(FILE *out) const
+{
+    for (size_t i = 0; i < stats_.size(); i++)
+    {
+        double utilization = wall_ms_ > 0 ? 100.0 * stats_[i].busy_ms / wall_ms_ : 0;
+        fprintf(out, "thread %zu (%s): %d jobs (%d stolen), busy %.1f ms (%.1f%%)\n", i,
+                stats_[i].home == kFormatCount ? "shared" : FormatName((DocumentFormat)stats_[i].home),
+                stats_[i].jobs, stats_[i].stolen, stats_[i].busy_ms, utilization);
+    }
+    for (int home = 0; home <= kFormatCount; home++)
+    {
+        int threads = 0;
+        int jobs = 0;
+        int stolen = 0;
+        double busy_ms = 0;
+        for (size_t i = 0; i < stats_.size(); i++)
+        {
+            if (stats_[i].home != home)
+                continue;
+            threads++;
+            jobs += stats_[i].jobs;
+            stolen += stats_[i].stolen;
+            busy_ms += stats_[i].busy_ms;
+        }
+        if (threads == 0)
+            continue;
+
+        double utilization = wall_ms_ > 0 ? 100.0 * busy_ms / (wall_ms_ * threads) : 0;
+        fprintf(out, "pool %s: %d threads, %d jobs (%d stolen), busy %.1f ms (%.1f%%)\n",
+                home == kFormatCount ? "shared" : FormatName((DocumentFormat)home),
+                threads, jobs, stolen, busy_ms, utilization);
+    }
+}
+
+bool WorkerPool::Take(int home, QueuedJob &job, bool &stolen)
+{
+    // Serve the thread's own format first, otherwise the longest queue
+    int source = -1;
+    if (home < kFormatCount && !queues_[home].empty())
+        source = home;
+    for (int i = 0; source < 0 && i < kFormatCount; i++)
+    {
+        if (!queues_[i].empty())
+            source = i;
+    }
+    for (int i = 0; source != home && i < kFormatCount; i++)
+    {
+        if (source >= 0 && queues_[i].size() > queues_[source].size())
+            source = i;
+    }
+    if (source < 0)
+        return false;
+
+    queues_[source].Pop(job);
+    queued_--;
+    stolen = home < kFormatCount && source != home;
+    return true;
+}
+
+void WorkerPool::Work(size_t index)
+{
+    int home = stats_[index].home;
+    for (;;)
+    {
+        QueuedJob queued;
+        bool stolen = false;
+        {
+            unique_lock<mutex> lock(mutex_);
+            while (!Take(home, queued, stolen))
+            {
+                if (closed_)
+                    return;
+                not_empty_.wait(lock);
+            }
+            not_full_.notify_one();
+        }
+
+        ConversionResult result = RunJob(queued.job);
+        stats_[index].jobs++;
+        if (stolen)
+            stats_[index].stolen++;
+        stats_[index].busy_ms += result.elapsed_ms;
+        on_complete_(queued, result);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef CONVERT_POOL_H_
+#define CONVERT_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job.h"
+#include "scheduler.h"
+
+// Number of threads to start for each DocumentFormat. The extra last entry,
+// at index kFormatCount, counts shared threads with no format of their own.
+typedef std::vector<int> ThreadCounts;
+
+// Parses either a plain thread count ("8", all shared) or per-format counts
+// such as "word=4,excel=2,powerpoint=1". Returns false on a malformed spec.
+bool ParseThreadCounts(const std::string &spec, ThreadCounts &counts);
+
+// Returns the total number of threads in `counts`.
+int TotalThreads(const ThreadCounts &counts);
+
+// Runs conversions on a fixed set of threads inside this process, sharing one
+// initialized library. Library::EnableThreadSafety(true) must have been called
+// before the pool is created.
+//
+// Jobs are queued per format, shortest expected job first, and each thread
+// belongs to the pool of one format. A thread serves its own format's queue
+// first and, when that is empty, steals from the longest of the other
+// queues, so a burst of one format does not leave the other pools idle.
+class WorkerPool
+{
+public:
+    // Called on the worker thread once a job finishes.
+    typedef std::function<void(const QueuedJob &, const ConversionResult &)> CompletionHandler;
+
+    // Starts the threads in `counts`. Submit blocks once `capacity` jobs are
+    // queued across all formats.
+    WorkerPool(const ThreadCounts &counts, size_t capacity, const CompletionHandler &on_complete);
+    ~WorkerPool();
+
+    // Queues a job on its format's queue, waiting for room if the pool is full.
+    void Submit(const QueuedJob &job);
+
+    // Stops accepting jobs and waits for the queued ones to finish.
+    void Join();
+
+    // Writes one line per thread and then one per format pool, each with its
+    // jobs, stolen jobs and the share of the pool's lifetime spent converting.
+    void PrintUtilization(FILE *out) const;
+
+private:
+    struct ThreadStats
+    {
+        int home;
+        int jobs;
+        int stolen;
+        double busy_ms;
+
+        ThreadStats() : home(kFormatCount), jobs(0), stolen(0), busy_ms(0) {}
+    };
+
+    // Takes the next job for a thread of pool `home`. Must hold mutex_.
+    bool Take(int home, QueuedJob &job, bool &stolen);
+    void Work(size_t index);
+
+    CompletionHandler on_complete_;
+    size_t capacity_;
+    size_t queued_;
+    std::vector<ShortestJobQueue> queues_;
+    bool closed_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::vector<std::thread> threads_;
+    std::vector<ThreadStats> stats_;
+    std::chrono::steady_clock::time_point start_;
+    double wall_ms_;
+};
+
+#endif  // CONVERT_POOL_H_
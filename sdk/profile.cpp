@@ -0,0 +1,139 @@
+#include "profile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "clone.h"
+#include "job.h"
+
+using namespace std;
+
+// Recursively clones the directory tree at `from` into `to`
+static bool CloneTree(const string &from, const string &to)
+{
+    struct stat info;
+    if (lstat(from.c_str(), &info) < 0)
+        return false;
+
+    if (S_ISLNK(info.st_mode))
+    {
+        char target[4096];
+        ssize_t length = readlink(from.c_str(), target, sizeof(target) - 1);
+        if (length < 0)
+            return false;
+        target[length] = '\0';
+        return symlink(target, to.c_str()) == 0;
+    }
+    if (!S_ISDIR(info.st_mode))
+        return CloneFile(from, to, info.st_mode);
+
+    if (mkdir(to.c_str(), info.st_mode & 0777) < 0 && errno != EEXIST)
+        return false;
+
+    DIR *directory = opendir(from.c_str());
+    if (!directory)
+        return false;
+    bool ok = true;
+    while (dirent *entry = readdir(directory))
+    {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        if (!CloneTree(from + "/" + name, to + "/" + name))
+        {
+            ok = false;
+            break;
+        }
+    }
+    closedir(directory);
+    return ok;
+}
+
+static int RemoveEntry(const char *path, const struct stat *, int, FTW *)
+{
+    return remove(path);
+}
+
+// Recursively deletes `path`, ignoring it if it does not exist
+static void RemoveTree(const string &path)
+{
+    nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+ProfileCache::ProfileCache(const string &root)
+    : root_(root), golden_(root + "/golden")
+{
+}
+
+bool ProfileCache::EnsureGolden(const string &sample)
+{
+    if (access(golden_.c_str(), F_OK) == 0)
+        return true;
+    if (sample.empty())
+    {
+        fprintf(stderr, "no golden profile in %s and no --warmup document to build one\n", root_.c_str());
+        return false;
+    }
+
+    // Build into a scratch directory and rename it into place, so that a
+    // failed or interrupted build never leaves a half-made golden profile
+    string building = root_ + "/golden.building";
+    RemoveTree(building);
+    mkdir(root_.c_str(), 0755);
+    if (mkdir(building.c_str(), 0755) < 0)
+    {
+        perror(building.c_str());
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+    {
+        setenv("XDG_CONFIG_HOME", building.c_str(), 1);
+        ConversionResult result = WarmUpEngine(sample);
+        _exit(result.code == foxit::e_ErrSuccess ? 0 : 1);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || rename(building.c_str(), golden_.c_str()) < 0)
+    {
+        fprintf(stderr, "building the golden profile in %s failed\n", building.c_str());
+        RemoveTree(building);
+        return false;
+    }
+    return true;
+}
+
+string ProfileCache::Checkout(int slot)
+{
+    string path = SlotPath(slot);
+    if (access(path.c_str(), F_OK) != 0 && !CloneTree(golden_, path))
+        fprintf(stderr, "cloning the golden profile into %s failed\n", path.c_str());
+    return path;
+}
+
+void ProfileCache::Reset(int slot)
+{
+    RemoveTree(SlotPath(slot));
+    Checkout(slot);
+}
+
+string ProfileCache::SlotPath(int slot) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/slot-%d", slot);
+    return root_ + name;
+}
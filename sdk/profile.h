@@ -0,0 +1,39 @@
+#ifndef CONVERT_PROFILE_H_
+#define CONVERT_PROFILE_H_
+
+#include <string>
+
+// Keeps one "golden" LibreOffice user profile and a private clone of it for
+// each worker slot, so that concurrent conversions never share (and fight
+// over) a profile and none of them pays for first-run profile creation.
+//
+// The engine finds its profile through XDG_CONFIG_HOME, which is
+// process-wide, so clones are only used by forked workers.
+class ProfileCache
+{
+public:
+    // Profiles live under `root`: the template in `root`/golden and the
+    // clones in `root`/slot-<n>.
+    explicit ProfileCache(const std::string &root);
+
+    // Builds the golden profile by converting `sample` in a forked child
+    // pointed at an empty profile directory, unless it already exists.
+    // Returns false if it is missing and could not be built.
+    bool EnsureGolden(const std::string &sample);
+
+    // Returns the XDG_CONFIG_HOME directory for `slot`, cloning the golden
+    // profile into it first if the slot has no clone yet.
+    std::string Checkout(int slot);
+
+    // Discards whatever the last job left in the slot's clone and replaces
+    // it with a fresh clone of the golden profile.
+    void Reset(int slot);
+
+private:
+    std::string SlotPath(int slot) const;
+
+    std::string root_;
+    std::string golden_;
+};
+
+#endif  // CONVERT_PROFILE_H_
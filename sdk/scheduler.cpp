@@ -0,0 +1,37 @@
+#include "scheduler.h"
+
+using namespace std;
+
+void ShortestJobQueue::Push(const QueuedJob &job)
+{
+    Entry entry;
+    entry.job = job;
+    entry.queued_at = chrono::steady_clock::now();
+    entries_.push_back(entry);
+}
+
+bool ShortestJobQueue::Pop(QueuedJob &job)
+{
+    if (entries_.empty())
+        return false;
+
+    // The queue only holds a bounded window of jobs, so a linear scan is
+    // cheaper than keeping a heap whose keys change as jobs age
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    size_t best = 0;
+    double best_score = 0;
+    for (size_t i = 0; i < entries_.size(); i++)
+    {
+        double waited_ms = chrono::duration<double, milli>(now - entries_[i].queued_at).count();
+        double score = entries_[i].job.cost - waited_ms;
+        if (i == 0 || score < best_score)
+        {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    job = entries_[best].job;
+    entries_.erase(entries_.begin() + best);
+    return true;
+}
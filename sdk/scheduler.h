@@ -0,0 +1,45 @@
+#ifndef CONVERT_SCHEDULER_H_
+#define CONVERT_SCHEDULER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "job.h"
+
+// A job waiting to be run, tagged with a caller chosen id (for example the
+// manifest line it came from) and its estimated cost from EstimateCost.
+struct QueuedJob
+{
+    int id;
+    double cost;
+    ConversionJob job;
+
+    QueuedJob() : id(0), cost(0) {}
+};
+
+// Hands out queued jobs shortest expected job first. Every millisecond a job
+// waits lowers its effective cost by one millisecond, so a long job is
+// eventually preferred over newer short ones and cannot starve.
+class ShortestJobQueue
+{
+public:
+    void Push(const QueuedJob &job);
+
+    // Removes the job with the lowest effective cost. Returns false if empty.
+    bool Pop(QueuedJob &job);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+private:
+    struct Entry
+    {
+        QueuedJob job;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    std::vector<Entry> entries_;
+};
+
+#endif  // CONVERT_SCHEDULER_H_
@@ -0,0 +1,32 @@
+#ifndef CONVERT_SHA256_H_
+#define CONVERT_SHA256_H_
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental SHA-256, used to give conversion results content-derived
+// names. Update may be called any number of times before HexDigest.
+class Sha256
+{
+public:
+    Sha256();
+
+    void Update(const void *data, size_t size);
+    void Update(const std::string &text) { Update(text.data(), text.size()); }
+
+    // Finishes the hash and returns it as 64 lower-case hex digits. The
+    // object must not be updated afterwards.
+    std::string HexDigest();
+
+private:
+    void Transform(const unsigned char *block);
+
+    uint32_t state_[8];
+    unsigned char block_[64];
+    size_t block_used_;
+    uint64_t length_;
+};
+
+#endif  // CONVERT_SHA256_H_
@@ -0,0 +1,321 @@
+#include "stream.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "filestream.h"
+#include "mapped.h"
+#include "optimize.h"
+#include "writer.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::common::file;
+using namespace foxit::pdf;
+
+static long long g_streamed_threshold = 256LL * 1024 * 1024;
+
+void SetStreamedReads(long long threshold)
+{
+    g_streamed_threshold = threshold;
+}
+
+bool IsStreamTarget(const string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISSOCK(info.st_mode));
+}
+
+bool CreateScratchPdf(const string &target, string &scratch)
+{
+    string::size_type slash = target.rfind('/');
+    string directory = slash == string::npos ? "." : target.substr(0, slash);
+
+    string pattern = directory + "/.convert-XXXXXX.pdf";
+    int fd = mkstemps(&pattern[0], 4);
+    if (fd < 0)
+        return false;
+    close(fd);
+    scratch = pattern;
+    return true;
+}
+
+// Opens the target for writing: connects to a Unix socket, or opens a FIFO,
+// which blocks until the reader has it open too. Returns -1 on failure.
+static int OpenStreamTarget(const string &target, bool &is_socket)
+{
+    struct stat info;
+    if (stat(target.c_str(), &info) < 0)
+        return -1;
+
+    is_socket = S_ISSOCK(info.st_mode);
+    if (!is_socket)
+        return open(target.c_str(), O_WRONLY | O_CLOEXEC);
+
+    struct sockaddr_un address;
+    if (target.size() >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, target.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+// PDFDoc::StartSaveAs flags for a save mode
+static uint32 SaveFlags(SaveMode mode)
+{
+    switch (mode)
+    {
+    case kSaveLinearized:
+        return PDFDoc::e_SaveFlagLinearized;
+    case kSaveCompact:
+        return PDFDoc::e_SaveFlagXRefStream | PDFDoc::e_SaveFlagRemoveRedundantObjects | PDFDoc::e_SaveFlagNoOriginal;
+    default:
+        return PDFDoc::e_SaveFlagNormal;
+    }
+}
+
+// Runs OptimizeImages on `doc`, which was loaded from `reader`, and reports
+// the time taken. If it does not finish in time `doc` is loaded again, with
+// its original images, and the result of that load is returned.
+static ErrorCode ReduceImages(PDFDoc &doc, ReaderCallback *reader, const ImageOptions &options,
+                              ConversionResult &result)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool optimized = OptimizeImages(doc, options);
+    AddStat(result, "optimize_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    if (optimized)
+        return e_ErrSuccess;
+
+    AddStat(result, "optimize_abandoned", 1);
+    result.publishable = false;
+    doc = PDFDoc(reader);
+    return LoadMappedPdf(doc);
+}
+
+// Runs SubsetFonts on `doc` and reports the time taken and how much smaller
+// the embedded font programs became. Returns false if subsetting failed.
+static bool SubsetFontsTimed(PDFDoc &doc, ConversionResult &result)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    uint64 font_bytes = EmbeddedFontBytes(doc);
+    if (!SubsetFonts(doc))
+        return false;
+    uint64 subset_bytes = EmbeddedFontBytes(doc);
+    AddStat(result, "subset_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    AddStat(result, "subset_saved_kb", font_bytes > subset_bytes ? (font_bytes - subset_bytes) / 1024.0 : 0);
+    return true;
+}
+
+void SavePdf(const string &pdf_path, const string &output, const ConversionJob &job, const string &copy,
+             ConversionResult &result)
+{
+    uint32 save_flags = SaveFlags(job.save_mode);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Open the output first so that a reader waiting on a FIFO sees end of
+    // file, rather than blocking forever, if the PDF cannot be loaded
+    AsyncWriter::Target target = AsyncWriter::kTargetFile;
+    int fd;
+    if (IsStreamTarget(output))
+    {
+        bool is_socket = false;
+        fd = OpenStreamTarget(output, is_socket);
+        target = is_socket ? AsyncWriter::kTargetSocket : AsyncWriter::kTargetPipe;
+    }
+    else
+        fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        result.code = e_ErrFile;
+        result.message = string("cannot open output: ") + strerror(errno);
+        return;
+    }
+    // Linearizing goes back to fill in the hint tables, which a pipe cannot do
+    if (target != AsyncWriter::kTargetFile && (save_flags & PDFDoc::e_SaveFlagLinearized))
+    {
+        close(fd);
+        result.code = e_ErrParam;
+        result.message = "linearized output must be written to a file";
+        return;
+    }
+    int copy_fd = copy.empty() ? -1 : open(copy.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    Progressive::State state = Progressive::e_Error;
+    bool copied = false;
+    try
+    {
+        // Mapping a PDF of several hundred megabytes and reading it ahead
+        // would make it all resident at once, so those are read on demand
+        struct stat info;
+        bool streamed_read = stat(pdf_path.c_str(), &info) == 0 && info.st_size >= g_streamed_threshold;
+        MappedReader mapped;
+        FileStreamReader file_stream;
+        ReaderCallback *reader = NULL;
+        if (streamed_read ? file_stream.Open(pdf_path) : mapped.Open(pdf_path))
+            reader = streamed_read ? static_cast<ReaderCallback *>(&file_stream) : &mapped;
+        if (!reader)
+        {
+            result.code = e_ErrFile;
+            result.message = string("cannot open converted PDF: ") + strerror(errno);
+        }
+        else
+        {
+            PDFDoc doc(reader);
+            ErrorCode code = LoadMappedPdf(doc);
+            if (code == e_ErrSuccess && job.images.dpi > 0)
+                code = ReduceImages(doc, reader, job.images, result);
+            if (code != e_ErrSuccess)
+            {
+                result.code = code;
+                result.message = "cannot load converted PDF";
+            }
+            else if (job.subset_fonts && !SubsetFontsTimed(doc, result))
+            {
+                result.code = kErrSubsetFailed;
+                result.message = "cannot subset embedded fonts";
+            }
+            else
+            {
+                AsyncWriter writer(fd, target, copy_fd);
+                state = FinishProgressive(doc.StartSaveAs(&writer, save_flags));
+                if (state == Progressive::e_Finished && !writer.Flush())
+                    state = Progressive::e_Error;
+                copied = !writer.CopyFailed();
+                if (state == Progressive::e_Finished)
+                {
+                    AddStat(result, "converted_kb", reader->GetSize() / 1024.0);
+                    if (streamed_read)
+                        AddStat(result, "streamed_read", 1);
+                    AddStat(result, "output_kb", writer.GetSize() / 1024.0);
+                }
+                if (state != Progressive::e_Finished)
+                {
+                    result.code = e_ErrFile;
+                    result.message = "writing the PDF to the output failed";
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        if (copy_fd >= 0)
+            close(copy_fd);
+        throw;
+    }
+    close(fd);
+    if (copy_fd >= 0)
+        close(copy_fd);
+
+    // An incomplete copy must not be published
+    if (!copy.empty() && !copied)
+        unlink(copy.c_str());
+    if (state == Progressive::e_Finished)
+        AddStat(result, "save_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+}
+
+// Sends everything from the current offset of `fd` to its end into `out`
+// with sendfile, so the bytes go from the page cache, or tmpfs, straight into
+// the pipe or socket without being copied through a user buffer. Sets
+// `unsupported` if the kernel cannot do that for this pair of descriptors
+// and nothing was sent; the caller then copies instead.
+static bool SendFileData(int fd, int out, bool &unsupported)
+{
+    // A reader that hangs up must fail the delivery rather than kill the
+    // process, and sendfile has no MSG_NOSIGNAL. Block SIGPIPE around it
+    // and discard the one it raises, unless one was pending already.
+    sigset_t pipe_signal, previous, pending;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, &previous);
+
+    unsupported = false;
+    bool sent_any = false;
+    ssize_t count;
+    while ((count = sendfile(out, fd, NULL, 1 << 30)) > 0 || (count < 0 && errno == EINTR))
+        sent_any = sent_any || count > 0;
+    int error = errno;
+
+    if (count < 0 && error == EPIPE && !was_pending)
+    {
+        struct timespec no_wait = {0, 0};
+        sigtimedwait(&pipe_signal, NULL, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (count < 0 && !sent_any && (error == EINVAL || error == ENOSYS))
+        unsupported = true;
+    errno = error;
+    return count == 0;
+}
+
+void SendToStream(int fd, const string &target, ConversionResult &result)
+{
+    bool is_socket = false;
+    int out = OpenStreamTarget(target, is_socket);
+    if (out < 0)
+    {
+        result.code = e_ErrFile;
+        result.message = string("cannot open output stream: ") + strerror(errno);
+        return;
+    }
+
+    bool unsupported = false;
+    bool ok = SendFileData(fd, out, unsupported);
+    if (unsupported)
+    {
+        ok = true;
+        AsyncWriter writer(out, is_socket ? AsyncWriter::kTargetSocket : AsyncWriter::kTargetPipe);
+        char buffer[65536];
+        FX_FILESIZE offset = 0;
+        ssize_t count = 0;
+        while (ok && (count = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            ok = writer.WriteBlock(buffer, offset, count);
+            offset += count;
+        }
+        ok = ok && count == 0 && writer.Flush();
+    }
+    close(out);
+
+    if (!ok)
+    {
+        result.code = e_ErrFile;
+        result.message = "output stream closed before the PDF was written";
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0)
+        AddStat(result, "sent_kb", info.st_size / 1024.0);
+    AddStat(result, "zero_copy", unsupported ? 0 : 1);
+}
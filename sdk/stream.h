@@ -0,0 +1,39 @@
+#ifndef CONVERT_STREAM_H_
+#define CONVERT_STREAM_H_
+
+#include <string>
+
+#include "job.h"
+
+// Sets the size from which SavePdf reads the converted PDF from disk block
+// by block as the SDK asks for it, instead of mapping it into memory whole.
+// Call before any jobs run. The default is 256 MiB.
+void SetStreamedReads(long long threshold);
+
+// Returns true if `path` is a FIFO or a Unix socket that a reader is waiting
+// on, rather than a regular file to convert into.
+bool IsStreamTarget(const std::string &path);
+
+// Creates an empty scratch file next to `target` for the engine to write the
+// PDF into before it is saved to `target`. Returns false if it cannot be created.
+bool CreateScratchPdf(const std::string &target, std::string &scratch);
+
+// Loads the converted PDF at `pdf_path`, applies the job's image options and
+// saves it as the job's save mode asks into `output`. That is either a
+// regular file or a FIFO or Unix socket, whose reader receives the first
+// blocks while the rest is still being written. When `copy` is set, the saved
+// bytes are also written to that file, which is removed again if the copy is
+// incomplete. SDK failures are thrown; other failures are reported through
+// `result`. That also gets the sizes before and after, as converted_kb and
+// output_kb, and the time taken as save_ms.
+void SavePdf(const std::string &pdf_path, const std::string &output, const ConversionJob &job,
+             const std::string &copy, ConversionResult &result);
+
+// Copies everything readable from `fd` into the FIFO or Unix socket at
+// `target`, such as a finished PDF that needs no saving. The data is moved
+// with sendfile where the kernel supports it. Reports the size sent as
+// sent_kb, and zero_copy as 1 if sendfile carried it or 0 if it had to be
+// copied through user space. Failures are reported through `result`.
+void SendToStream(int fd, const std::string &target, ConversionResult &result);
+
+#endif  // CONVERT_STREAM_H_
@@ -0,0 +1,330 @@
+#include "text.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "pdf/fs_pdfdoc.h"
+#include "pdf/fs_pdfpage.h"
+#include "pdf/fs_search.h"
+
+#include "mapped.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::pdf;
+
+// Pages each thread may run ahead of the first page not yet written. This
+// bounds the finished pages held in memory waiting for a slower one.
+static const int kPagesAheadPerThread = 2;
+
+static int g_text_threads = 1;
+
+void SetTextThreads(int threads)
+{
+    g_text_threads = threads;
+}
+
+string TextPath(const string &output)
+{
+    return OutputBase(output) + "-text.json";
+}
+
+// State shared by the threads extracting one job
+struct TextWork
+{
+    MappedReader *reader;
+    FILE *file;
+    int pages;
+    int window;
+    atomic<int> next;
+    atomic<long long> chars;
+    // The rest is guarded by `state_mutex`
+    mutex state_mutex;
+    condition_variable written_changed;
+    // Pages before this one have been written
+    int written;
+    // Finished pages waiting for an earlier one
+    map<int, string> ready;
+    bool failed;
+    int code;
+    string message;
+};
+
+// Records the first failure and stops the other threads. Must hold work.state_mutex.
+static void Fail(TextWork &work, int code, const string &message)
+{
+    if (!work.failed)
+    {
+        work.code = code;
+        work.message = message;
+        work.failed = true;
+    }
+    work.written_changed.notify_all();
+}
+
+static void AppendUtf8(string &json, uint32_t code_point)
+{
+    if (code_point < 0x80)
+        json += (char)code_point;
+    else if (code_point < 0x800)
+    {
+        json += (char)(0xC0 | (code_point >> 6));
+        json += (char)(0x80 | (code_point & 0x3F));
+    }
+    else if (code_point < 0x10000)
+    {
+        json += (char)(0xE0 | (code_point >> 12));
+        json += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        json += (char)(0x80 | (code_point & 0x3F));
+    }
+    else
+    {
+        json += (char)(0xF0 | (code_point >> 18));
+        json += (char)(0x80 | ((code_point >> 12) & 0x3F));
+        json += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        json += (char)(0x80 | (code_point & 0x3F));
+    }
+}
+
+// Appends `text` as a JSON string. Characters that are not valid code points
+// become U+FFFD, so that there is still exactly one per box.
+static void AppendJsonString(string &json, const WString &text)
+{
+    json += '"';
+    for (FX_STRSIZE i = 0; i < text.GetLength(); i++)
+    {
+        uint32_t code_point = (uint32_t)text.GetAt(i);
+        if (code_point == '"' || code_point == '\\')
+        {
+            json += '\\';
+            json += (char)code_point;
+        }
+        else if (code_point < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", code_point);
+            json += escaped;
+        }
+        else if (code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF))
+            AppendUtf8(json, 0xFFFD);
+        else
+            AppendUtf8(json, code_point);
+    }
+    json += '"';
+}
+
+// Builds the JSON object for page `index` of `doc`. Returns false if the
+// page cannot be parsed.
+static bool PageJson(PDFDoc &doc, int index, long long &chars, string &json)
+{
+    PDFPage page = doc.GetPage(index);
+    if (FinishProgressive(page.StartParse(PDFPage::e_ParsePageNormal, NULL, false)) != Progressive::e_Finished)
+        return false;
+
+    TextPage text(page, TextPage::e_ParseTextNormal);
+    int count = text.GetCharCount();
+    WString characters = text.GetChars(0, -1);
+
+    char number[96];
+    snprintf(number, sizeof(number), "{\"page\":%d,\"width\":%.2f,\"height\":%.2f,\"text\":", index + 1, page.GetWidth(),
+             page.GetHeight());
+    json = number;
+    AppendJsonString(json, characters);
+    json += ",\"boxes\":[";
+    // One box per character of the text, even if the SDK reports a
+    // different count, so that consumers can pair them by position
+    for (FX_STRSIZE i = 0; i < characters.GetLength(); i++)
+    {
+        RectF box;
+        if (i < count)
+            box = text.GetCharInfo(i).char_box;
+        snprintf(number, sizeof(number), "%s[%.2f,%.2f,%.2f,%.2f]", i > 0 ? "," : "", box.left, box.bottom, box.right,
+                 box.top);
+        json += number;
+    }
+    json += "]}";
+    chars += characters.GetLength();
+    return true;
+}
+
+// Writes out the finished pages that follow the last written one. Must hold
+// work.state_mutex.
+static void WriteReadyPages(TextWork &work)
+{
+    while (!work.failed && !work.ready.empty() && work.ready.begin()->first == work.written)
+    {
+        const string &json = work.ready.begin()->second;
+        if ((work.written > 0 && fputs(",\n", work.file) < 0) || fwrite(json.data(), 1, json.size(), work.file) != json.size())
+            Fail(work, e_ErrFile, string("cannot write text: ") + strerror(errno));
+        work.ready.erase(work.ready.begin());
+        work.written++;
+    }
+    work.written_changed.notify_all();
+}
+
+// Extracts pages of `doc` until none are left. SDK failures are thrown.
+static void ExtractLoop(PDFDoc &doc, TextWork &work)
+{
+    long long chars = 0;
+    for (int index = work.next++; index < work.pages; index = work.next++)
+    {
+        // Pages are taken in order, so the thread holding the first unwritten
+        // page never waits here
+        {
+            unique_lock<mutex> lock(work.state_mutex);
+            while (!work.failed && index >= work.written + work.window)
+                work.written_changed.wait(lock);
+            if (work.failed)
+                break;
+        }
+
+        string json;
+        bool parsed = PageJson(doc, index, chars, json);
+        lock_guard<mutex> lock(work.state_mutex);
+        if (!parsed)
+        {
+            Fail(work, e_ErrUnknown, "cannot parse page");
+            break;
+        }
+        work.ready[index].swap(json);
+        WriteReadyPages(work);
+    }
+    work.chars += chars;
+}
+
+static void RunExtractLoop(PDFDoc &doc, TextWork &work)
+{
+    try
+    {
+        ExtractLoop(doc, work);
+    }
+    catch (const foxit::Exception &e)
+    {
+        lock_guard<mutex> lock(work.state_mutex);
+        Fail(work, e.GetErrCode(), (const char *)e.GetMessage());
+    }
+    catch (const std::exception &e)
+    {
+        lock_guard<mutex> lock(work.state_mutex);
+        Fail(work, e_ErrUnknown, e.what());
+    }
+}
+
+// Runs on each extra text thread, with a PDFDoc of its own: documents are not
+// shared between threads, but the mapping is
+static void ExtractPages(TextWork *work)
+{
+    try
+    {
+        PDFDoc doc(work->reader);
+        if (LoadMappedPdf(doc) != e_ErrSuccess)
+        {
+            lock_guard<mutex> lock(work->state_mutex);
+            Fail(*work, e_ErrFormat, "cannot load PDF for text");
+            return;
+        }
+        RunExtractLoop(doc, *work);
+    }
+    catch (const foxit::Exception &e)
+    {
+        lock_guard<mutex> lock(work->state_mutex);
+        Fail(*work, e.GetErrCode(), (const char *)e.GetMessage());
+    }
+    catch (const std::exception &e)
+    {
+        lock_guard<mutex> lock(work->state_mutex);
+        Fail(*work, e_ErrUnknown, e.what());
+    }
+}
+
+void ExtractText(int fd, const string &output, ConversionResult &result)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string path = TextPath(output);
+    MappedReader reader;
+    if (!reader.Open(fd))
+    {
+        fprintf(stderr, "text for %s failed: cannot map PDF: %s\n", output.c_str(), strerror(errno));
+        AddStat(result, "text_failed", 1);
+        return;
+    }
+    FILE *file = fopen(path.c_str(), "we");
+    if (!file)
+    {
+        fprintf(stderr, "text for %s failed: cannot create %s: %s\n", output.c_str(), path.c_str(), strerror(errno));
+        AddStat(result, "text_failed", 1);
+        return;
+    }
+
+    TextWork work;
+    work.reader = &reader;
+    work.file = file;
+    work.pages = 0;
+    work.window = 0;
+    work.next = 0;
+    work.chars = 0;
+    work.written = 0;
+    work.failed = false;
+    work.code = e_ErrSuccess;
+    vector<thread> helpers;
+    fputs("{\"pages\":[\n", file);
+    try
+    {
+        PDFDoc doc(&reader);
+        if (LoadMappedPdf(doc) != e_ErrSuccess)
+        {
+            lock_guard<mutex> lock(work.state_mutex);
+            Fail(work, e_ErrFormat, "cannot load PDF for text");
+        }
+        else
+        {
+            // Every thread loads the document, so start no more than there
+            // are pages, and extract on this thread too
+            work.pages = doc.GetPageCount();
+            int threads = max(1, min(g_text_threads, work.pages));
+            work.window = threads * kPagesAheadPerThread;
+            for (int i = 1; i < threads; i++)
+                helpers.push_back(thread(ExtractPages, &work));
+            RunExtractLoop(doc, work);
+        }
+    }
+    catch (const foxit::Exception &e)
+    {
+        lock_guard<mutex> lock(work.state_mutex);
+        Fail(work, e.GetErrCode(), (const char *)e.GetMessage());
+    }
+    catch (const std::exception &e)
+    {
+        lock_guard<mutex> lock(work.state_mutex);
+        Fail(work, e_ErrUnknown, e.what());
+    }
+    for (size_t i = 0; i < helpers.size(); i++)
+        helpers[i].join();
+
+    fputs("\n]}\n", file);
+    if (fclose(file) != 0 && !work.failed)
+        Fail(work, e_ErrFile, string("cannot write text: ") + strerror(errno));
+    if (work.failed)
+    {
+        unlink(path.c_str());
+        fprintf(stderr, "text for %s failed: %s (%d)\n", output.c_str(), work.message.c_str(), work.code);
+        AddStat(result, "text_failed", 1);
+        return;
+    }
+    AddStat(result, "text_pages", work.pages);
+    AddStat(result, "text_chars", (double)work.chars);
+    AddStat(result, "text_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,30 @@
+#ifndef CONVERT_TEXT_H_
+#define CONVERT_TEXT_H_
+
+#include <string>
+
+#include "job.h"
+
+// Sets how many threads extract the text of one job. With more than one,
+// Library::EnableThreadSafety(true) must have been called. Defaults to 1.
+void SetTextThreads(int threads);
+
+// The path of the text sidecar for a job writing to `output`:
+// "<output without extension>-text.json".
+std::string TextPath(const std::string &output);
+
+// Extracts the text of every page of the PDF open at `fd` with TextPage and
+// writes it, with a box for each character, to TextPath(output):
+//
+//   {"pages":[{"page":1,"width":612.00,"height":792.00,"text":"...",
+//              "boxes":[[left,bottom,right,top],...]},...]}
+//
+// boxes[i] belongs to the i-th code point of text. Pages are parsed on the
+// text threads, each with its own PDFDoc over one mapping of the file, and
+// written out in order as soon as they are ready; only a few pages per
+// thread are held in memory at a time. Reports text_pages, text_chars and
+// text_ms. Like thumbnails, a failure does not fail the job: the sidecar is
+// removed, text_failed is reported and the reason goes to stderr.
+void ExtractText(int fd, const std::string &output, ConversionResult &result);
+
+#endif  // CONVERT_TEXT_H_
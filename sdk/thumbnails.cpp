@@ -0,0 +1,249 @@
+#include "thumbnails.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "common/fs_image.h"
+#include "common/fs_render.h"
+#include "pdf/fs_pdfdoc.h"
+#include "pdf/fs_pdfpage.h"
+
+#include "mapped.h"
+
+using namespace std;
+using namespace foxit;
+using namespace foxit::common;
+using namespace foxit::pdf;
+
+static int g_render_threads = 1;
+
+// Pixel buffers kept between jobs, so that rendering does not allocate and
+// fault in a fresh bitmap for every page. Each render thread holds one for
+// as long as it runs and grows it when a page needs more. Buffers larger
+// than kMaxPooledBuffer, which only big thumbnail sizes need, are freed
+// rather than kept, so that one such job does not pin them for good.
+static const size_t kMaxPooledBuffer = 1024 * 1024 * 4;
+static mutex g_buffers_mutex;
+static vector<vector<uint8> > g_buffers;
+
+static vector<uint8> TakeBuffer()
+{
+    lock_guard<mutex> lock(g_buffers_mutex);
+    if (g_buffers.empty())
+        return vector<uint8>();
+    vector<uint8> buffer;
+    buffer.swap(g_buffers.back());
+    g_buffers.pop_back();
+    return buffer;
+}
+
+static void ReturnBuffer(vector<uint8> &buffer)
+{
+    if (buffer.capacity() > kMaxPooledBuffer)
+    {
+        vector<uint8>().swap(buffer);
+        return;
+    }
+    lock_guard<mutex> lock(g_buffers_mutex);
+    g_buffers.push_back(vector<uint8>());
+    g_buffers.back().swap(buffer);
+}
+
+void SetRenderThreads(int threads)
+{
+    g_render_threads = threads;
+}
+
+string ThumbnailPath(const string &output, int index, const ThumbnailOptions &options)
+{
+    ostringstream path;
+    path << OutputBase(output) << "-page" << index + 1 << "." << (options.format == kThumbnailJpeg ? "jpg" : "png");
+    return path.str();
+}
+
+// State shared by the threads rendering one job
+struct RenderWork
+{
+    MappedReader *reader;
+    const string *output;
+    const ThumbnailOptions *options;
+    int pages;
+    atomic<int> next;
+    atomic<int> rendered;
+    atomic<bool> failed;
+    mutex failure_mutex;
+    int code;
+    string message;
+};
+
+// Records the first failure and stops the other threads taking more pages
+static void Fail(RenderWork &work, int code, const string &message)
+{
+    lock_guard<mutex> lock(work.failure_mutex);
+    if (!work.failed)
+    {
+        work.code = code;
+        work.message = message;
+        work.failed = true;
+    }
+}
+
+// Renders page `index` of `doc` into `buffer` and saves it as an image.
+// Returns false after recording the failure in `work`.
+static bool RenderPage(PDFDoc &doc, int index, RenderWork &work, vector<uint8> &buffer)
+{
+    const ThumbnailOptions &options = *work.options;
+    PDFPage page = doc.GetPage(index);
+    if (FinishProgressive(page.StartParse(PDFPage::e_ParsePageNormal, NULL, false)) != Progressive::e_Finished)
+    {
+        Fail(work, e_ErrUnknown, "cannot parse page");
+        return false;
+    }
+
+    // Fit the longer side of the page, as displayed, to the thumbnail size
+    Rotation rotation = page.GetRotation();
+    float width = page.GetWidth();
+    float height = page.GetHeight();
+    if (rotation == e_Rotation90 || rotation == e_Rotation270)
+        swap(width, height);
+    float scale = options.size / max(width, height);
+    int pixel_width = max(1, (int)(width * scale + 0.5f));
+    int pixel_height = max(1, (int)(height * scale + 0.5f));
+
+    size_t needed = (size_t)pixel_width * pixel_height * 4;
+    if (buffer.size() < needed)
+        buffer.resize(needed);
+    Bitmap bitmap(pixel_width, pixel_height, Bitmap::e_DIBArgb, &buffer[0], pixel_width * 4);
+    bitmap.FillRect(0xFFFFFFFF, NULL);
+
+    Renderer renderer(bitmap, false);
+    Matrix matrix = page.GetDisplayMatrix(0, 0, pixel_width, pixel_height, rotation);
+    Progressive::State state = FinishProgressive(options.draft ? renderer.StartQuickRender(page, matrix, NULL)
+                                                               : renderer.StartRender(page, matrix, NULL));
+    if (state != Progressive::e_Finished)
+    {
+        Fail(work, e_ErrUnknown, "cannot render page");
+        return false;
+    }
+
+    Image image;
+    if (!image.AddFrame(bitmap) || !image.SaveAs(ThumbnailPath(*work.output, index, options).c_str()))
+    {
+        Fail(work, e_ErrFile, "cannot write thumbnail");
+        return false;
+    }
+    return true;
+}
+
+// Renders pages of `doc` until none are left. SDK failures are thrown.
+static void RenderLoop(PDFDoc &doc, RenderWork &work)
+{
+    vector<uint8> buffer = TakeBuffer();
+    try
+    {
+        for (int index = work.next++; index < work.pages && !work.failed; index = work.next++)
+        {
+            if (RenderPage(doc, index, work, buffer))
+                work.rendered++;
+        }
+    }
+    catch (...)
+    {
+        ReturnBuffer(buffer);
+        throw;
+    }
+    ReturnBuffer(buffer);
+}
+
+// Runs on each extra render thread, with a PDFDoc of its own: documents are
+// not shared between threads, but the mapping is
+static void RenderPages(RenderWork *work)
+{
+    try
+    {
+        PDFDoc doc(work->reader);
+        if (LoadMappedPdf(doc) != e_ErrSuccess)
+            Fail(*work, e_ErrFormat, "cannot load PDF for thumbnails");
+        else
+            RenderLoop(doc, *work);
+    }
+    catch (const foxit::Exception &e)
+    {
+        Fail(*work, e.GetErrCode(), (const char *)e.GetMessage());
+    }
+    catch (const std::exception &e)
+    {
+        Fail(*work, e_ErrUnknown, e.what());
+    }
+}
+
+void RenderThumbnails(int fd, const string &output, const ThumbnailOptions &options, ConversionResult &result)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MappedReader reader;
+    if (!reader.Open(fd))
+    {
+        fprintf(stderr, "thumbnails for %s failed: cannot map PDF: %s\n", output.c_str(), strerror(errno));
+        AddStat(result, "thumbnails_failed", 1);
+        return;
+    }
+
+    RenderWork work;
+    work.reader = &reader;
+    work.output = &output;
+    work.options = &options;
+    work.pages = 0;
+    work.next = 0;
+    work.rendered = 0;
+    work.failed = false;
+    work.code = e_ErrSuccess;
+    vector<thread> helpers;
+    try
+    {
+        PDFDoc doc(&reader);
+        if (LoadMappedPdf(doc) != e_ErrSuccess)
+            Fail(work, e_ErrFormat, "cannot load PDF for thumbnails");
+        else
+        {
+            // Every thread loads the document, so start no more than there
+            // are pages, and render on this thread too
+            work.pages = min(options.pages, doc.GetPageCount());
+            for (int i = 1; i < min(g_render_threads, work.pages); i++)
+                helpers.push_back(thread(RenderPages, &work));
+            RenderLoop(doc, work);
+        }
+    }
+    catch (const foxit::Exception &e)
+    {
+        Fail(work, e.GetErrCode(), (const char *)e.GetMessage());
+    }
+    catch (const std::exception &e)
+    {
+        Fail(work, e_ErrUnknown, e.what());
+    }
+    for (size_t i = 0; i < helpers.size(); i++)
+        helpers[i].join();
+
+    if (work.failed)
+    {
+        // Like a failed text sidecar, leave no partial set behind
+        for (int i = 0; i < work.pages; i++)
+            unlink(ThumbnailPath(output, i, options).c_str());
+        fprintf(stderr, "thumbnails for %s failed: %s (%d)\n", output.c_str(), work.message.c_str(), work.code);
+        AddStat(result, "thumbnails_failed", 1);
+        return;
+    }
+    AddStat(result, "thumbnails", work.rendered);
+    AddStat(result, "thumbnails_ms", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+}
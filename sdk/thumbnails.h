@@ -0,0 +1,24 @@
+#ifndef CONVERT_THUMBNAILS_H_
+#define CONVERT_THUMBNAILS_H_
+
+#include <string>
+
+#include "job.h"
+
+// Sets how many threads render the thumbnails of one job. With more than
+// one, Library::EnableThreadSafety(true) must have been called. Defaults to 1.
+void SetRenderThreads(int threads);
+
+// The path of the thumbnail of page `index` (counting from 0) for a job
+// writing to `output`: "<output without extension>-page<n>.<format>".
+std::string ThumbnailPath(const std::string &output, int index, const ThumbnailOptions &options);
+
+// Renders the first options.pages pages of the PDF open at `fd` into images
+// next to `output` (see ThumbnailPath). Pages are shared out between the
+// render threads, each of which loads its own PDFDoc from one mapping of the
+// file. Reports thumbnails and thumbnails_ms. A failure does not fail the
+// job, whose PDF is fine: the thumbnails already written are removed and
+// it is reported as thumbnails_failed, with the reason on stderr.
+void RenderThumbnails(int fd, const std::string &output, const ThumbnailOptions &options, ConversionResult &result);
+
+#endif  // CONVERT_THUMBNAILS_H_
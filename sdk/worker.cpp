@@ -0,0 +1,176 @@
+#include "worker.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Forks a child that runs `run` and reports its result over a pipe
+static bool StartForked(const function<ConversionResult()> &run, int timeout_ms, ForkedJob &forked,
+                        const string &profile)
+{
+    // The engine processes the SDK spawns in the child must not inherit the
+    // write end, or one that outlives the child keeps the parent reading
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return false;
+
+    forked.start = chrono::steady_clock::now();
+    forked.timeout_ms = timeout_ms;
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // Child: run the job and report "<code>\t<stats>\t<message>" to the parent. Skip
+        // Library::Release and static destructors, the parent still owns them.
+        // A process group of its own lets a timeout kill the engine too
+        setpgid(0, 0);
+        close(fds[0]);
+        if (!profile.empty())
+            setenv("XDG_CONFIG_HOME", profile.c_str(), 1);
+        ConversionResult result = run();
+        ostringstream report;
+        report << result.code << "\t" << result.stats << "\t" << result.message;
+        string data = report.str();
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t count = write(fds[1], data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;
+            written += count;
+        }
+        _exit(0);
+    }
+
+    // Also set here, so the group exists before anyone can signal it
+    setpgid(pid, pid);
+    close(fds[1]);
+    forked.pid = pid;
+    forked.result_fd = fds[0];
+    return true;
+}
+
+bool StartForkedJob(const ConversionJob &job, ForkedJob &forked, const string &profile)
+{
+    return StartForked([&job]() { return RunJob(job); }, job.timeout_ms, forked, profile);
+}
+
+int RemainingMs(const ForkedJob &forked)
+{
+    if (forked.timeout_ms <= 0)
+        return -1;
+    double elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - forked.start).count();
+    return elapsed_ms >= forked.timeout_ms ? 0 : (int)(forked.timeout_ms - elapsed_ms) + 1;
+}
+
+ConversionResult FinishForkedJob(const ForkedJob &forked)
+{
+    string report;
+    char chunk[1024];
+    bool timed_out = false;
+    for (;;)
+    {
+        if (!timed_out)
+        {
+            pollfd ready = {forked.result_fd, POLLIN, 0};
+            int polled = poll(&ready, 1, RemainingMs(forked));
+            if (polled < 0 && errno == EINTR)
+                continue;
+            if (polled == 0)
+            {
+                // The killed group closes the pipe, ending the loop
+                kill(-forked.pid, SIGKILL);
+                timed_out = true;
+            }
+        }
+        ssize_t count = read(forked.result_fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        report.append(chunk, count);
+    }
+
+    int status = 0;
+    while (waitpid(forked.pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    ConversionResult result;
+    result.elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - forked.start).count();
+    close(forked.result_fd);
+
+    if (timed_out)
+    {
+        result.code = kErrTimedOut;
+        ostringstream message;
+        message << "conversion timed out after " << forked.timeout_ms << " ms";
+        result.message = message.str();
+        return result;
+    }
+    if (report.empty())
+    {
+        result.code = kErrWorkerDied;
+        if (WIFSIGNALED(status))
+            result.message = string("worker crashed with signal ") + strsignal(WTERMSIG(status));
+        else
+            result.message = "worker exited without a result";
+        return result;
+    }
+
+    string::size_type first = report.find('\t');
+    string::size_type second = first == string::npos ? string::npos : report.find('\t', first + 1);
+    result.code = atoi(report.substr(0, first).c_str());
+    if (second != string::npos)
+    {
+        result.stats = report.substr(first + 1, second - first - 1);
+        result.message = report.substr(second + 1);
+    }
+    return result;
+}
+
+ConversionResult RunForkedJob(const ConversionJob &job, const string &profile)
+{
+    ForkedJob forked;
+    if (!StartForkedJob(job, forked, profile))
+    {
+        ConversionResult result;
+        result.code = foxit::e_ErrUnknown;
+        result.message = string("fork failed: ") + strerror(errno);
+        return result;
+    }
+    return FinishForkedJob(forked);
+}
+
+ConversionResult RunForkedWarmUp(const string &sample, const string &profile)
+{
+    ForkedJob forked;
+    if (!StartForked([&sample]() { return WarmUpEngine(sample); }, 0, forked, profile))
+    {
+        ConversionResult result;
+        result.code = foxit::e_ErrUnknown;
+        result.message = string("fork failed: ") + strerror(errno);
+        return result;
+    }
+    return FinishForkedJob(forked);
+}
@@ -0,0 +1,50 @@
+#ifndef CONVERT_WORKER_H_
+#define CONVERT_WORKER_H_
+
+#include <chrono>
+#include <string>
+
+#include <sys/types.h>
+
+#include "job.h"
+
+// A conversion running in a child process forked from an initialized parent.
+// The child shares the parent's warmed SDK state copy-on-write, runs a single
+// job and exits, so a crash in the engine only takes down that one job.
+struct ForkedJob
+{
+    pid_t pid;
+    int result_fd;
+    std::chrono::steady_clock::time_point start;
+    // The job's timeout_ms, or 0 for no limit
+    int timeout_ms;
+};
+
+// Forks a child that runs `job` and reports its result over a pipe. When
+// `profile` is set the child points the engine at that XDG_CONFIG_HOME
+// (see ProfileCache). The child leads a process group of its own, which the
+// engine processes it starts join. Returns false if the child could not be
+// started.
+bool StartForkedJob(const ConversionJob &job, ForkedJob &forked,
+                    const std::string &profile = std::string());
+
+// Returns how many milliseconds the job has left before its timeout, for
+// use as a poll timeout: -1 if it has no limit and 0 once it has run out.
+int RemainingMs(const ForkedJob &forked);
+
+// Waits for the child to exit and collects its result. A child that dies
+// without reporting is turned into a kErrWorkerDied result. One still
+// running at its timeout is killed along with its process group and turned
+// into a kErrTimedOut result.
+ConversionResult FinishForkedJob(const ForkedJob &forked);
+
+// Convenience wrapper that starts a forked job and waits for it.
+ConversionResult RunForkedJob(const ConversionJob &job,
+                              const std::string &profile = std::string());
+
+// Converts `sample` as a warm-up (see WarmUpEngine) in a forked child, so
+// that a crash during the warm-up cannot take the parent down with it.
+ConversionResult RunForkedWarmUp(const std::string &sample,
+                                 const std::string &profile = std::string());
+
+#endif  // CONVERT_WORKER_H_
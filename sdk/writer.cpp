@@ -0,0 +1,179 @@
+#include "writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+AsyncWriter::AsyncWriter(int fd, Target target, int copy_fd)
+    : fd_(fd), target_(target), copy_fd_(copy_fd), copy_failed_(copy_fd < 0), size_(0), buffers_(kBufferCount),
+      filling_(-1), writing_(false), failed_(false), stopping_(false)
+{
+    for (size_t i = 0; i < buffers_.size(); i++)
+        free_.push_back((int)i);
+    thread_ = thread(&AsyncWriter::Work, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    Flush();
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+}
+
+FX_FILESIZE AsyncWriter::GetSize()
+{
+    lock_guard<mutex> lock(mutex_);
+    return size_;
+}
+
+FX_BOOL AsyncWriter::Flush()
+{
+    unique_lock<mutex> lock(mutex_);
+    Submit();
+    while (!queued_.empty() || writing_)
+        done_.wait(lock);
+    return !failed_;
+}
+
+FX_BOOL AsyncWriter::WriteBlock(const void *data, FX_FILESIZE offset, size_t size)
+{
+    unique_lock<mutex> lock(mutex_);
+    if (failed_ || (target_ != kTargetFile && offset != size_))
+        return false;
+
+    const char *bytes = (const char *)data;
+    while (size > 0)
+    {
+        // Blocks that carry on where the last one ended share its buffer
+        if (filling_ >= 0)
+        {
+            const Buffer &last = buffers_[filling_];
+            if (offset != last.offset + (FX_FILESIZE)last.used || last.used == kBufferSize)
+                Submit();
+        }
+        if (filling_ < 0)
+        {
+            while (free_.empty() && !failed_)
+                done_.wait(lock);
+            if (failed_)
+                return false;
+            filling_ = free_.front();
+            free_.pop_front();
+            // Buffers are only allocated once a save needs them
+            buffers_[filling_].data.resize(kBufferSize);
+            buffers_[filling_].offset = offset;
+            buffers_[filling_].used = 0;
+        }
+
+        Buffer &buffer = buffers_[filling_];
+        size_t count = min(size, kBufferSize - buffer.used);
+        memcpy(&buffer.data[buffer.used], bytes, count);
+        buffer.used += count;
+        bytes += count;
+        offset += count;
+        size -= count;
+        if (offset > size_)
+            size_ = offset;
+    }
+    return true;
+}
+
+void AsyncWriter::Submit()
+{
+    if (filling_ < 0)
+        return;
+    queued_.push_back(filling_);
+    filling_ = -1;
+    work_.notify_one();
+}
+
+bool AsyncWriter::CopyFailed()
+{
+    lock_guard<mutex> lock(mutex_);
+    return copy_failed_;
+}
+
+bool AsyncWriter::Write(int fd, Target target, const Buffer &buffer)
+{
+    size_t written = 0;
+    while (written < buffer.used)
+    {
+        const char *bytes = &buffer.data[written];
+        size_t size = buffer.used - written;
+        ssize_t count;
+        if (target == kTargetFile)
+            count = pwrite(fd, bytes, size, buffer.offset + written);
+        else if (target == kTargetSocket)
+            // A reader that hangs up must fail the save, not kill the process with SIGPIPE
+            count = send(fd, bytes, size, MSG_NOSIGNAL);
+        else
+            count = write(fd, bytes, size);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+        // Work blocks SIGPIPE, so a pipe whose reader hung up leaves one
+        // pending on this thread. Discard it; the failed write is enough.
+        if (count < 0 && errno == EPIPE)
+        {
+            sigset_t pipe_signal;
+            sigemptyset(&pipe_signal);
+            sigaddset(&pipe_signal, SIGPIPE);
+            struct timespec no_wait = {0, 0};
+            sigtimedwait(&pipe_signal, NULL, &no_wait);
+            errno = EPIPE;
+        }
+        if (count <= 0)
+            return false;
+        written += count;
+    }
+    return true;
+}
+
+void AsyncWriter::Work()
+{
+    // A pipe reader that hangs up must fail the save, not kill the process
+    // with SIGPIPE, and write has no MSG_NOSIGNAL. All writes happen on this
+    // thread, so blocking the signal here covers them.
+    sigset_t pipe_signal;
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    unique_lock<mutex> lock(mutex_);
+    for (;;)
+    {
+        while (queued_.empty() && !stopping_)
+            work_.wait(lock);
+        if (queued_.empty())
+            return;
+
+        int index = queued_.front();
+        queued_.pop_front();
+        writing_ = true;
+        // Once a write has failed the rest of the save is dropped
+        bool skip = failed_;
+        bool skip_copy = copy_failed_;
+        lock.unlock();
+        bool written = skip || Write(fd_, target_, buffers_[index]);
+        bool copied = skip_copy || Write(copy_fd_, kTargetFile, buffers_[index]);
+        lock.lock();
+
+        writing_ = false;
+        if (!written)
+            failed_ = true;
+        if (!copied)
+            copy_failed_ = true;
+        free_.push_back(index);
+        done_.notify_all();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef CONVERT_WRITER_H_
+#define CONVERT_WRITER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/file/fs_file.h"
+
+// Takes PDF output from PDFDoc::StartSaveAs and writes it on a background
+// thread, so the saving thread does not block on every block write.
+// Consecutive blocks are gathered into a fixed set of buffers. WriteBlock
+// only waits when every buffer is queued; Flush is the one call that waits
+// for the writes themselves.
+class AsyncWriter : public foxit::common::file::WriterCallback
+{
+public:
+    enum Target
+    {
+        // A regular file, written with pwrite at whatever offset the SDK asks for
+        kTargetFile,
+        // A pipe or socket, which only accepts writes that append
+        kTargetPipe,
+        kTargetSocket
+    };
+
+    static const size_t kBufferCount = 8;
+    static const size_t kBufferSize = 256 * 1024;
+
+    // Writes to `fd`, and also to the regular file `copy_fd` when one is
+    // given. Both stay owned by the caller and must stay open until Flush
+    // has returned.
+    AsyncWriter(int fd, Target target, int copy_fd = -1);
+    ~AsyncWriter();
+
+    void Release() {}
+    FX_FILESIZE GetSize();
+    // Waits until everything written so far has reached the file descriptor.
+    // Returns false if any write failed.
+    FX_BOOL Flush();
+    FX_BOOL WriteBlock(const void *data, FX_FILESIZE offset, size_t size);
+
+    // Whether writing the copy failed. That does not fail the save itself.
+    bool CopyFailed();
+
+private:
+    struct Buffer
+    {
+        std::vector<char> data;
+        FX_FILESIZE offset;
+        size_t used;
+    };
+
+    AsyncWriter(const AsyncWriter &);
+    AsyncWriter &operator=(const AsyncWriter &);
+
+    // Queues the buffer being filled, if any. Must hold mutex_.
+    void Submit();
+    static bool Write(int fd, Target target, const Buffer &buffer);
+    void Work();
+
+    int fd_;
+    Target target_;
+    int copy_fd_;
+    bool copy_failed_;
+    FX_FILESIZE size_;
+    std::vector<Buffer> buffers_;
+    // Index of the buffer gathering the latest blocks, or -1
+    int filling_;
+    std::deque<int> free_;
+    std::deque<int> queued_;
+    bool writing_;
+    bool failed_;
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable done_;
+    std::thread thread_;
+};
+
+#endif  // CONVERT_WRITER_H_
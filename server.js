@@ -1,9 +1,36 @@
-const { exec } = require('child_process');
 const express = require('express');
 const multer = require('multer');
 const path = require('path');
-const fs = require('fs');
-const { randomUUID } = require('crypto');
+const net = require('net');
+const os = require('os');
+const { ConverterPool } = require('./converter');
+const { Staging } = require('./staging');
+
+// Long-lived converter processes that initialize Foxit PDF SDK once and are
+// reused for every upload. Each one runs jobs in forked children so an
+// engine crash only fails the request that caused it. They share a result
+// cache, through which identical uploads that arrive together also wait for
+// a single conversion rather than each running their own.
+const converters = new ConverterPool(
+  Number(process.env.CONVERTER_WORKERS ?? Math.max(1, Math.floor(os.cpus().length / 2))),
+  [
+    '--fork',
+    '--cache', process.env.CONVERTER_CACHE_DIR ?? path.join(__dirname, 'cache'),
+    '--cache-size', process.env.CONVERTER_CACHE_MB ?? '1024',
+    // PDF/A output needs the compliance engine's resource folder
+    ...(process.env.COMPLIANCE_RESOURCES ? ['--compliance', process.env.COMPLIANCE_RESOURCES] : [])
+  ]
+);
+
+// Working folders for uploads and converted PDFs. When STAGING_RAM_DIR
+// points at a tmpfs mount (for example /dev/shm/convert), requests are
+// staged there until STAGING_RAM_BUDGET bytes are in use, after which new
+// requests fall back to the `files` folder on disk.
+const staging = new Staging({
+  diskRoot: path.join(__dirname, 'files'),
+  ramRoot: process.env.STAGING_RAM_DIR,
+  ramBudget: Number(process.env.STAGING_RAM_BUDGET ?? 256 * 1024 * 1024)
+});
 
 // Create a custom upload file storage for multer that places
 // each file in a folder with a random UUID to avoid file name
@@ -11,18 +38,42 @@ const { randomUUID } = require('crypto');
 const upload = multer({
   storage: multer.diskStorage({
     destination: (req, file, callback) => {
-      // Generate a new folder and ensure it exists.
-      const folder = path.join(__dirname, 'files', randomUUID());
-      fs.mkdirSync(folder, { recursive: true });
+      // Reserve room for the upload and a PDF of similar size. Requests
+      // without a Content-Length cannot be budgeted and go to disk.
+      const uploadSize = Number(req.headers['content-length'] ?? 0);
+      req.staging = staging.allocate(uploadSize * 2);
 
-      callback(null, folder)
+      callback(null, req.staging.folder)
     },
     filename: (req, file, callback) => {
-      callback(null, file.originalname);
+      // Tabs and newlines separate fields in converter requests, so keep
+      // them out of file names.
+      callback(null, file.originalname.replace(/[\t\r\n]/g, '_'));
     }
   })
 });
 
+// Setting IMAGE_DPI (for example 150) downsamples and recompresses the
+// photos in every PDF to that resolution, at JPEG quality IMAGE_QUALITY
+// (1-5). A PDF whose images take longer than IMAGE_BUDGET_MS is sent with
+// its original images instead.
+const IMAGE_SETTINGS = process.env.IMAGE_DPI
+  ? [
+    `image_dpi=${process.env.IMAGE_DPI}`,
+    `image_quality=${process.env.IMAGE_QUALITY ?? 3}`,
+    `image_budget_ms=${process.env.IMAGE_BUDGET_MS ?? 5000}`
+  ]
+  : [];
+
+// Setting SUBSET_FONTS=1 cuts the fonts embedded in every PDF down to the
+// glyphs it uses, which matters most for CJK fonts of several megabytes.
+const FONT_SETTINGS = process.env.SUBSET_FONTS === '1' ? ['subset_fonts=1'] : [];
+
+// Linearized PDFs stay available for byte-range requests at a stable URL
+// for this long, keyed by the id of their staging folder.
+const LINEARIZED_TTL_MS = Number(process.env.LINEARIZED_TTL_MS ?? 10 * 60 * 1000);
+const linearized = new Map();
+
 const app = express();
 
 app.get('/', (req, res) => {
@@ -31,30 +82,116 @@ app.get('/', (req, res) => {
 
 // Create post endpoint that accepts a file in a Form Data request.
 // The file should be in a form field called "docxFile"
+// Set the form field "linearize" to 1 to get a linearized PDF served with
+// byte-range support, instead of streaming it in the response.
+// Set the form field "pdfa" to 1b, 2b, 2u or 3b to get PDF/A output. It
+// cannot be combined with "linearize" or "compact".
+// Set the form field "compact" to 1 to get a smaller PDF that takes a little
+// longer to produce.
 app.post('/', upload.single('docxFile'), (req, res) => {
   // Get DOCX file path
   const docxPath = req.file.path;
-  // Create file path for PDF file
-  const pdfPath = path.join(req.file.destination, path.parse(req.file.filename).name + '.pdf')
-  
-  // Event handler that will delete the temporary folder in `files` once the file
-  // has been downloaded to the browser.
-  res.on('finish', () => {
-    fs.rmSync(req.file.destination, { recursive: true });
+  const pdfaSettings = /^(1b|2b|2u|3b)$/.test(req.body.pdfa ?? '') ? [`pdfa=${req.body.pdfa}`] : [];
+
+  // The compliance engine writes the PDF/A file itself, which would undo a
+  // linearized or compact save.
+  if (pdfaSettings.length > 0 && (req.body.linearize === '1' || req.body.compact === '1')) {
+    staging.release(req.staging);
+    res.status(400).send("PDF/A output cannot be linearized or compacted.");
+    return;
+  }
+
+  if (req.body.linearize === '1') {
+    // Convert into the staging folder and redirect to a URL that serves the
+    // file with Range support, so a viewer can show the first page before
+    // the rest has downloaded. The folder is kept until the URL expires.
+    const id = path.basename(req.file.destination);
+    const name = path.parse(req.file.filename).name + '.pdf';
+    const pdfPath = path.join(req.file.destination, name);
+
+    converters.convert(docxPath, pdfPath, { settings: [...IMAGE_SETTINGS, ...FONT_SETTINGS, 'save=linearized'].join(','), timeout: 30000 })
+      .then(() => {
+        const expires = Date.now() + LINEARIZED_TTL_MS;
+        setTimeout(() => {
+          linearized.delete(id);
+          staging.release(req.staging);
+        }, LINEARIZED_TTL_MS);
+        linearized.set(id, { pdfPath, expires });
+        res.redirect(303, `/pdf/${id}/${encodeURIComponent(name)}`);
+      })
+      .catch(() => {
+        staging.release(req.staging);
+        res.status(500).send("An unexpected error occurred. Please try again.");
+      });
+    return;
+  }
+
+  // The converter streams the PDF into this Unix socket as it is saved, so
+  // the first bytes reach the client while the rest is still being written.
+  const pdfSocket = path.join(req.file.destination, 'pdf.sock');
+  const receiver = net.createServer();
+  const received = new Promise((resolve) => {
+    receiver.once('connection', (connection) => {
+      // Only the converter connects, and only once.
+      receiver.close();
+      res.type('application/pdf');
+      // The response is ended once the converter reports success, so a
+      // conversion that fails part way through is not mistaken for a whole PDF.
+      connection.pipe(res, { end: false });
+      connection.on('end', resolve);
+    });
+  });
+
+  // Event handler that will close the socket and delete the temporary folder
+  // once the file has been downloaded to the browser, or the client has gone away.
+  res.on('close', () => {
+    receiver.close();
+    staging.release(req.staging);
   })
-  
-  // Execute the C++ application, passing in the DOCX file name as the first parameter and the
-  // PDF file name as the second.
-  exec(`/app/sdk/convert "${docxPath}" "${pdfPath}"`, { timeout: 30000 }, (error, stdout, stderr) => {
-    // Process any errors and return an error response to the user.
-    if (error) {
+
+  // The socket could not be created in the staging folder. Without a
+  // listener this error would take down the whole server.
+  receiver.on('error', () => {
+    staging.release(req.staging);
+    if (!res.headersSent) {
       res.status(500).send("An unexpected error occurred. Please try again.");
-      return;
     }
+  });
 
-    // If there were no errors, send the file back in the response.
-    res.sendFile(pdfPath);
-  })
+  receiver.listen(pdfSocket, () => {
+    // Hand the DOCX path and the PDF socket to one of the converter workers.
+    const settings = [...IMAGE_SETTINGS, ...FONT_SETTINGS, ...pdfaSettings, ...(req.body.compact === '1' ? ['save=compact'] : [])].join(',');
+    converters.convert(docxPath, pdfSocket, { settings, timeout: 30000 })
+      .then(() => received)
+      .then(() => res.end())
+      .catch(() => {
+        if (res.headersSent) {
+          // Part of the PDF has gone out already, so all we can do is cut
+          // the response short rather than let it look complete.
+          res.destroy();
+        } else {
+          // Process any errors and return an error response to the user.
+          res.status(500).send("An unexpected error occurred. Please try again.");
+        }
+      });
+  });
+});
+
+// Serve a linearized PDF until it expires. sendFile answers Range and
+// If-Range requests, so viewers can fetch the pages they show first.
+app.get('/pdf/:id/:name', (req, res) => {
+  const entry = linearized.get(req.params.id);
+  if (!entry) {
+    res.status(404).send("This PDF has expired. Please convert the document again.");
+    return;
+  }
+
+  // The document belongs to whoever uploaded it, so keep it out of shared caches.
+  const maxAge = Math.max(0, Math.floor((entry.expires - Date.now()) / 1000));
+  res.sendFile(entry.pdfPath, {
+    cacheControl: false,
+    headers: { 'Content-Type': 'application/pdf', 'Cache-Control': `private, max-age=${maxAge}` }
+  });
 });
 
 app.listen(process.env.PORT ?? 3000);
@@ -0,0 +1,44 @@
+const fs = require('fs');
+const path = require('path');
+const { randomUUID } = require('crypto');
+
+// Hands out per-request working folders, preferring a RAM-backed directory
+// (such as a tmpfs mount) while the bytes reserved there stay within a
+// budget, and falling back to a folder on disk otherwise.
+class Staging {
+  constructor({ diskRoot, ramRoot, ramBudget }) {
+    this.diskRoot = diskRoot;
+    this.ramRoot = ramRoot;
+    this.ramBudget = ramRoot ? ramBudget : 0;
+    this.ramReserved = 0;
+  }
+
+  // Create a new folder for a request expected to use about `bytes` bytes
+  // (upload plus converted output). Returns `{ folder, bytes, inRam }`,
+  // which must be handed back to `release` once the request is done.
+  allocate(bytes) {
+    const inRam = bytes > 0 && this.ramReserved + bytes <= this.ramBudget;
+    const folder = path.join(inRam ? this.ramRoot : this.diskRoot, randomUUID());
+    fs.mkdirSync(folder, { recursive: true });
+
+    if (inRam) {
+      this.ramReserved += bytes;
+    }
+    return { folder, bytes, inRam };
+  }
+
+  // Delete the folder and return its reservation to the budget. Releasing
+  // an allocation again does nothing.
+  release(allocation) {
+    if (allocation.released) {
+      return;
+    }
+    allocation.released = true;
+    fs.rmSync(allocation.folder, { recursive: true, force: true });
+    if (allocation.inRam) {
+      this.ramReserved -= allocation.bytes;
+    }
+  }
+}
+
+module.exports = { Staging };